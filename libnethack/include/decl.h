@@ -306,6 +306,24 @@ enum target_location_units {
     TLU_NEXT, /* load the next diff */
 };
 
+/* How often a new save diff is checked by loading it and saving it again (see
+   log_neutral_turnstate); set via the NH4VERIFYSAVES environment variable. */
+enum save_verify_policy {
+    SVP_ALWAYS,         /* check every save diff */
+    SVP_INTERVAL,       /* check every Nth save diff */
+    SVP_LEVELCHANGE,    /* check the first save diff on each new level */
+    SVP_BACKGROUND,     /* check every save diff in a forked process */
+};
+
+/* Marked at the end of the third line of the log's header: by nothing for
+   LOG_FORMAT_TEXT (which is all that older versions wrote), and by
+   LOG_FORMAT_BINARY_TOKEN for LOG_FORMAT_BINARY. */
+enum log_format {
+    LOG_FORMAT_TEXT,    /* binary data is stored in base 64 */
+    LOG_FORMAT_BINARY,  /* binary data is stored raw, escaping newlines */
+};
+# define LOG_FORMAT_BINARY_TOKEN "binary"
+
 extern struct sinfo {
     int game_running;   /* ok to call nh_do_move */
     int gameover;       /* self explanatory? */
@@ -345,6 +363,10 @@ extern struct sinfo {
      *   find somewhere to recover to
      * * end_of_gamestate_location is the start of the line immediately after
      *   the one that gamestate_location point to.
+     * * end_of_binary_save_location is the start of the line immediately after
+     *   the one that binary_save_location points to, provided that
+     *   end_of_binary_save_for equals binary_save_location; otherwise, it
+     *   isn't known.
      */
     volatile int logfile;                             /* file descriptor */
     void *logfile_watchers;                /* on UNIX, an array of pid_t */
@@ -358,8 +380,31 @@ extern struct sinfo {
     long gamestate_location;                 /* bytes from start of file */
     long end_of_gamestate_location;          /* bytes from start of file */
     long emergency_recover_location;         /* bytes from start of file */
+    long end_of_binary_save_location;        /* bytes from start of file */
+    long end_of_binary_save_for;             /* bytes from start of file */
     boolean input_was_just_replayed;
     boolean ok_to_diff;
+
+    /* Save verification state. The verify_child fields describe a background
+       check that hasn't been collected yet; verify_child_recover_location is
+       where to recover to if it fails. */
+    enum save_verify_policy save_verify;
+    int save_verify_interval;
+    int save_verify_counter;
+    int save_verify_ledger;
+    int verify_child;                             /* a pid_t on UNIX */
+    long verify_child_recover_location;      /* bytes from start of file */
+    boolean in_verify_child;
+
+    /* How binary data in the log is compressed (an LZ4 HC level, or 0 for
+       LZ4's fast mode), and whether save lines are compressed and written on
+       a separate thread; set via NH4LOGCOMPRESSION and NH4LOGWRITER. */
+    int log_compression_level;
+    boolean log_writer_thread;
+
+    /* The format of the log's header, which decides how binary data is
+       written to it. */
+    enum log_format log_format;
 } program_state;
 
 #define panic(...) panic_core(__FILE__, __LINE__, __VA_ARGS__)
@@ -60,7 +60,6 @@ struct rm;
 struct test_move_cache;
 struct tmp_sym;
 struct trap;
-struct trietable;
 struct version_info;
 struct you;
 
@@ -670,6 +669,7 @@ extern boolean travelling(void);
 extern void init_test_move_cache(struct test_move_cache *);
 extern boolean test_move(int, int, int, int, int, int,
                          const struct test_move_cache *);
+extern void mark_terrain_changed(struct level *lev);
 extern void distmap_init(struct distmap_state *, int, int, struct monst *mtmp);
 extern int distmap(struct distmap_state *, int, int);
 extern int domove(const struct nh_cmd_arg *, enum u_interaction_mode,
@@ -715,6 +715,16 @@ extern void restore_history(struct memfile *mf);
 extern void free_history(void);
 extern const char *hist_lev_name(const d_level * l, boolean in_or_on);
 
+/* ### idindex.c ### */
+
+extern void index_monst(struct monst *mon);
+extern void unindex_monst(const struct monst *mon);
+extern struct monst *indexed_monst(unsigned id);
+extern void index_obj(struct obj *obj);
+extern void unindex_obj(const struct obj *obj);
+extern struct obj *indexed_obj(unsigned id);
+extern void clear_id_indexes(void);
+
 /* ### invent.c ### */
 
 extern void assigninvlet(struct obj *);
@@ -845,6 +855,10 @@ extern void log_neutral_turnstate(void);
 extern void log_backup_save(void);
 
 extern void log_sync(long, enum target_location_units, boolean);
+extern void log_free_save_index(void);
+extern void log_free_game_info_cache(void);
+extern void discard_log_read_buffer(void);
+extern void wait_for_log_writer(void);
 
 extern int replay_count_actions(boolean);
 extern void replay_next_cmd(char *);
@@ -949,6 +963,10 @@ extern void store_mf(int fd, struct memfile *mf);
 extern void mtag(struct memfile *mf, long tagdata,
                  enum memfile_tagtype tagtype);
 extern void mhint_mon_coordinates(struct memfile *mf);
+extern void msnapshot(struct memfile_snapshot *snap, const struct memfile *mf,
+                      int startpos, const struct memfile_tag *starttag);
+extern void mreplay(struct memfile *mf, const struct memfile_snapshot *snap);
+extern void mfreesnapshot(struct memfile_snapshot *snap);
 extern void mdiffflush(struct memfile *mf, boolean eof);
 extern void mdiffapply(char *diff, long difflen, struct memfile *diff_base,
                        struct memfile *new_memfile,
@@ -1170,6 +1188,7 @@ extern boolean is_flammable(const struct obj *);
 extern boolean is_rottable(const struct obj *);
 extern void place_object(struct obj *otmp, struct level *lev, int x, int y);
 extern void remove_object(struct obj *);
+extern int floor_objects_in_range(struct level *, int, int, int);
 extern void discard_minvent(struct monst *);
 extern void obj_extract_self(struct obj *);
 extern void extract_nobj(struct obj *, struct obj **,
@@ -1246,6 +1265,9 @@ extern void xkilled(struct monst *, int);
 extern void mon_to_stone(struct monst *);
 extern void mnexto(struct monst *);
 extern boolean mnearto(struct monst *, xchar, xchar, boolean);
+extern void set_monster_at(struct level *, xchar, xchar, struct monst *);
+extern int monsters_in_range(struct level *, int, int, int, struct monst **,
+                             int);
 extern void remove_monster(struct level *, xchar, xchar);
 extern void place_monster(struct monst *, xchar, xchar, boolean);
 extern void update_displacement(struct monst *);
@@ -1607,6 +1629,11 @@ extern void angry_priest(void);
 extern void clearpriests(void);
 extern void restpriest(struct monst *, boolean);
 
+/* ### profile.c ### */
+
+extern unsigned long long profile_start(void);
+extern void profile_stop(enum nh_profile_section, unsigned long long);
+
 /* ### prop.c ### */
 
 extern boolean teleport_at_will(const struct monst *);
@@ -1636,6 +1663,9 @@ extern boolean m_helpless(const struct monst *, enum helpless_mask mask);
 extern boolean u_helpless(enum helpless_mask mask);
 extern unsigned msensem_xy(struct monst *, struct monst *,
                            xchar, xchar);
+extern void begin_sensing_scope(void);
+extern void end_sensing_scope(void);
+extern void reset_sensing_scope(void);
 extern unsigned msensem(const struct monst *, const struct monst *);
 extern void enlighten_mon(struct monst *, int);
 extern void enlightenment(int);
@@ -1745,6 +1775,7 @@ extern void savegame(struct memfile *mf);
 extern void save_coords(struct memfile *mf, const coord *c, int n);
 extern void savelev(struct memfile *mf, xchar levnum);
 extern void freelev(xchar levnum);
+extern void mark_level_dirty(struct level *lev);
 extern void savefruitchn(struct memfile *mf);
 extern void freedynamicdata(void);
 extern int8_t save_encode_8(int8_t, int, int);
@@ -1985,8 +2016,7 @@ extern void save_timers(struct memfile *mf, struct level *lev, int range);
 extern void free_timers(struct level *lev);
 extern void restore_timers(struct memfile *mf, struct level *lev, int range,
                            boolean ghostly, long adjust);
-extern void relink_timers(boolean ghostly, struct level *lev,
-                          struct trietable **table);
+extern void relink_timers(boolean ghostly, struct level *lev);
 extern int wiz_timeout_queue(const struct nh_cmd_arg *);
 
 /* ### topten.c ### */
@@ -2094,6 +2124,7 @@ extern void vision_recalc(int);
 extern void block_point(int, int);
 extern void unblock_point(int, int);
 extern boolean clear_path(int, int, int, int, char **);
+extern unsigned clear_path_generation(void);
 extern void do_clear_area(int, int, int, void (*)(int, int, void *), void *);
 
 /* ### weapon.c ### */
@@ -122,18 +122,16 @@ extern coord bhitpos;   /* place where throw or zap hits or stops */
 
 # define NO_SPELL         0
 
-/* internal state of distmap; caller allocates so that it can be reused by
-   multiple distmap calls */
+/* a monster's handle on a distance field shared via distmap's cache;
+   caller allocates so that it can be reused by multiple distmap calls */
+struct distmap_field;
 struct distmap_state {
-    int onmap[COLNO][ROWNO];
-    boolean goodpos_cached[COLNO][ROWNO];
-    boolean goodpos[COLNO][ROWNO];
-    xchar travelstepx[2][COLNO * ROWNO];
-    xchar travelstepy[2][COLNO * ROWNO];
-    int curdist;
-    int tslen;
     struct monst *mon;
-    int mmflags;
+    int mmflags;        /* may be adjusted between distmap_init and distmap */
+    xchar goalx, goaly;
+    struct distmap_field *field;        /* NULL until first used */
+    unsigned serial;    /* field->serial when field was looked up */
+    int layers;         /* how far a search of ds's own would have got */
 };
 
 /* flags to control makemon() and/or goodpos() */
@@ -39,6 +39,12 @@ typedef struct ls_t {
     short flags;
     short type; /* type of light source */
     void *id;   /* source's identifier */
+
+    /* the squares lit last time, not saved; see do_light_sources() */
+    xchar lit_x, lit_y;
+    short lit_range;
+    unsigned lit_generation;    /* clear_path_generation(), or 0 if unset */
+    uint32_t lit_rows[2 * MAX_RADIUS + 1];
 } light_source;
 
 extern int n_dgns;
@@ -6,7 +6,7 @@
 #ifndef MEMFILE_H
 # define MEMFILE_H
 
-# define MEMFILE_HASHTABLE_SIZE 1009
+# define MEMFILE_TAGCHUNK_SIZE 1024
 
 /* SAVEBREAK (4.3-beta1 -> 4.3-beta2): these constants are only needed to parse
    the old -beta1 diff format. */
@@ -140,11 +140,27 @@ enum memfile_tagtype {
     MTAG_MXEYOU,
 };
 struct memfile_tag {
-    struct memfile_tag *next;
+    struct memfile_tag *prev_tag; /* the tag created before this one */
     long tagdata;
     enum memfile_tagtype tagtype;
     int pos;
 };
+
+/* A copy of part of a memfile, together with the tags that were placed in it,
+   that can be written into another memfile later (via mreplay) with the same
+   effect as the code that originally generated it. Tag positions are relative
+   to the start of buf. */
+struct memfile_snapshot_tag {
+    long tagdata;
+    enum memfile_tagtype tagtype;
+    int pos;
+};
+struct memfile_snapshot {
+    char *buf;
+    int len;
+    int ntags;
+    struct memfile_snapshot_tag *tags;
+};
 struct memfile {
     /* The basic information: the buffer, its length, and the file position */
     char *buf;
@@ -194,9 +210,14 @@ struct memfile {
        coordinate is in the byte afterwards). */
     int mon_coord_hint;
 
-    /* Tags to help in diffing. This is a hashtable for efficiency, using
-       chaining in the case of collisions. */
-    struct memfile_tag *tags[MEMFILE_HASHTABLE_SIZE];
+    /* Tags to help in diffing. The tags are allocated MEMFILE_TAGCHUNK_SIZE
+       at a time, and numbered in the order they were created. tagindex is an
+       open-addressed hashtable from (tagtype, tagdata) to the number of the
+       most recent tag with that key, plus 1 (0 is an empty slot). */
+    struct memfile_tag **tagchunks;
+    int ntags;
+    int *tagindex;
+    int tagindex_size;      /* 0, or a power of 2 */
 
     /* Where we are "semantically", for debug purposes. (It's possible this
        could someday be used to construct better error messages, too, but so
@@ -460,14 +460,23 @@ struct wseg {
 };
 
 
+/* monsters[][] and objects[][] are summarised in 8x8 tiles, one bit per
+   square, so that range queries (monsters_in_range(), floor_objects_in_range())
+   can skip the empty parts of the map */
+# define MAPTILE_COLS ((COLNO + 7) / 8)
+# define MAPTILE_ROWS ((ROWNO + 7) / 8)
+
 struct ls_t;
 struct level {
     char levname[64];   /* as given by the player via donamelevel */
     struct rm locations[COLNO][ROWNO];
     struct obj *objects[COLNO][ROWNO];
+    uint64_t object_tiles[MAPTILE_COLS][MAPTILE_ROWS];  /* not saved */
     struct obj *memobjects[COLNO][ROWNO];
     struct monst *monsters[COLNO][ROWNO];
     struct monst *dmonsters[COLNO][ROWNO]; /* displacement */
+    uint64_t monster_tiles[MAPTILE_COLS][MAPTILE_ROWS]; /* not saved */
+    unsigned terrain_generation;        /* for distmap(); not saved */
     struct trap *traps[COLNO][ROWNO];
     struct obj *objlist;
     struct obj *memobjlist;
@@ -503,6 +512,12 @@ struct level {
     int max_regions;
 
     d_level z;
+
+    /* Not saved: savegame()'s copy of this level's save data from the last
+       time it was saved, or NULL if the level may have changed since then (see
+       mark_level_dirty()). */
+    struct memfile_snapshot *save_cache;
+    long save_cache_key;
 };
 
 extern struct level *levels[MAXLINFO];  /* structure describing all levels */
@@ -522,7 +537,7 @@ extern struct level *level;             /* pointer to an entry in levels */
              ((lev)->monsters[x][y] != NULL && !(lev)->monsters[x][y]->mburied)
 # define MON_BURIED_AT(x,y) \
              (level->monsters[x][y] != NULL && level->monsters[x][y]->mburied)
-# define place_worm_seg(m,x,y)   (m)->dlevel->monsters[x][y] = m
+# define place_worm_seg(m,x,y)   set_monster_at((m)->dlevel, x, y, m)
 # define m_at(lev,x,y) \
              (MON_AT(lev,x,y) ? (lev)->monsters[x][y] : NULL)
 # define m_buried_at(x,y) \
@@ -70,6 +70,8 @@ nh_lib_exit(void)
     DEBUG_LOG("Exiting NetHack engine...\n");
 
     xmalloc_cleanup(&api_blocklist);
+    log_free_save_index();
+    log_free_game_info_cache();
 
     for (i = 0; i < PREFIX_COUNT; i++) {
         free(fqn_prefix[i]);
@@ -514,6 +516,9 @@ nh_play_game(int fd, enum nh_followmode followmode)
         int cmdidx;
         nh_bool command_from_user = FALSE;
 
+        /* in case the last command was left via longjmp inside one */
+        reset_sensing_scope();
+
         if (u_helpless(hm_all)) {
             cmd.cmd = "wait";
             cmdidx = get_command_idx("wait");
@@ -280,6 +280,7 @@ use_stethoscope(struct obj *obj, const struct nh_cmd_arg *arg)
     case SDOOR:
         You_hear(msgc_youdiscover, hollow_str, "door");
         cvt_sdoor_to_door(loc, &u.uz);  /* ->typ = DOOR */
+        mark_terrain_changed(level);
         if (Blind)
             feel_location(rx, ry);
         else
@@ -288,6 +289,7 @@ use_stethoscope(struct obj *obj, const struct nh_cmd_arg *arg)
     case SCORR:
         You_hear(msgc_youdiscover, hollow_str, "passage");
         loc->typ = CORR;
+        mark_terrain_changed(level);
         unblock_point(rx, ry);
         if (Blind)
             feel_location(rx, ry);
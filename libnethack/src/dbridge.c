@@ -676,6 +676,7 @@ close_drawbridge(int x, int y)
         break;
     }
     loc2->flags = W_NONDIGGABLE;
+    mark_terrain_changed(level);
     set_entity(x, y, &(occupants[0]));
     set_entity(x2, y2, &(occupants[1]));
     do_entity(&(occupants[0])); /* Do set_entity after first */
@@ -719,6 +720,7 @@ open_drawbridge(int x, int y)
     loc2 = &level->locations[x2][y2];
     loc2->typ = DOOR;
     loc2->flags = D_NODOOR;
+    mark_terrain_changed(level);
     set_entity(x, y, &(occupants[0]));
     set_entity(x2, y2, &(occupants[1]));
     do_entity(&(occupants[0])); /* do set_entity after first */
@@ -778,6 +780,7 @@ destroy_drawbridge(int x, int y)
         }
         loc1->typ = lava ? LAVAPOOL : MOAT;
         loc1->flags = 0;
+        mark_terrain_changed(level);
         if ((otmp = sobj_at(BOULDER, level, x, y)) != 0) {
             obj_extract_self(otmp);
             flooreffects(otmp, x, y, "fall");
@@ -793,6 +796,7 @@ destroy_drawbridge(int x, int y)
     wake_nearto(x, y, 500);
     loc2->typ = DOOR;
     loc2->flags = D_NODOOR;
+    mark_terrain_changed(level);
     if ((t = t_at(level, x, y)) != 0)
         deltrap(level, t);
     if ((t = t_at(level, x2, y2)) != 0)
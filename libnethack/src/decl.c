@@ -187,6 +187,7 @@ abort_turnstate(void)
     }
 
     xmalloc_cleanup(&turnstate.message_chain);
+    reset_sensing_scope();
 }
 
 /* Validates turnstate.move being empty. Returns TRUE if it isn't.
@@ -927,6 +927,7 @@ show_map_spot(int x, int y)
     /* Secret corridors are found, but not secret doors. */
     if (loc->typ == SCORR) {
         loc->typ = CORR;
+        mark_terrain_changed(level);
         unblock_point(x, y);
     }
 
@@ -1009,11 +1010,13 @@ findone(int zx, int zy, void *num)
 
     if (level->locations[zx][zy].typ == SDOOR) {
         cvt_sdoor_to_door(&level->locations[zx][zy], &u.uz);   /* .typ = DOOR */
+        mark_terrain_changed(level);
         magic_map_background(zx, zy, 0);
         newsym(zx, zy);
         (*(int *)num)++;
     } else if (level->locations[zx][zy].typ == SCORR) {
         level->locations[zx][zy].typ = CORR;
+        mark_terrain_changed(level);
         unblock_point(zx, zy);
         magic_map_background(zx, zy, 0);
         newsym(zx, zy);
@@ -1072,11 +1075,13 @@ openone(int zx, int zy, void *num)
             level->locations[zx][zy].flags = D_NODOOR;
         } else
             level->locations[zx][zy].flags = D_ISOPEN;
+        mark_terrain_changed(level);
         unblock_point(zx, zy);
         newsym(zx, zy);
         (*(int *)num)++;
     } else if (level->locations[zx][zy].typ == SCORR) {
         level->locations[zx][zy].typ = CORR;
+        mark_terrain_changed(level);
         unblock_point(zx, zy);
         newsym(zx, zy);
         (*(int *)num)++;
@@ -1338,6 +1343,7 @@ search_tile(int x, int y, struct monst *mon, int autosearch)
 
     if (lev->locations[x][y].typ == SDOOR) {
         cvt_sdoor_to_door(&lev->locations[x][y], m_mz(mon));
+        mark_terrain_changed(lev);
         if (you) {
             exercise(A_WIS, TRUE);
             action_completed();
@@ -1348,6 +1354,7 @@ search_tile(int x, int y, struct monst *mon, int autosearch)
             newsym(x, y);
     } else if (lev->locations[x][y].typ == SCORR) {
         lev->locations[x][y].typ = CORR;
+        mark_terrain_changed(lev);
         unblock_point(x, y); /* vision */
         if (you) {
             exercise(A_WIS, TRUE);
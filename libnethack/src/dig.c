@@ -82,6 +82,7 @@ mkcavepos(xchar x, xchar y, int dist, boolean waslit, boolean rockit)
         (IN_SIGHT | COULD_SEE) :     /* short-circuit vision recalc */
         COULD_SEE;
     loc->typ = (rockit ? STONE : ROOM);
+    mark_terrain_changed(level);
     if (dist >= 3)
         impossible("mkcavepos called with dist %d", dist);
     if (Blind)
@@ -133,6 +134,7 @@ mkcavearea(boolean rockit)
 
     if (!rockit && level->locations[u.ux][u.uy].typ == CORR) {
         level->locations[u.ux][u.uy].typ = ROOM;
+        mark_terrain_changed(level);
         if (waslit)
             level->locations[u.ux][u.uy].waslit = TRUE;
         newsym(u.ux, u.uy);     /* in case player is invisible */
@@ -414,6 +416,7 @@ dig(void)
         } else
             return 0;   /* statue or boulder got taken */
 
+        mark_terrain_changed(level);
         if (!does_block(level, dpx, dpy))
             unblock_point(dpx, dpy);    /* vision: can see through */
         if (Blind)
@@ -444,6 +447,7 @@ dig(void)
         }
         if (IS_DOOR(loc->typ) && (loc->flags & D_TRAPPED)) {
             loc->flags = D_NODOOR;
+            mark_terrain_changed(level);
             b_trapped("door", 0);
             newsym(dpx, dpy);
         }
@@ -798,6 +802,7 @@ dighole(struct monst *mon, boolean pit_only, boolean instant)
         loc->flags |= (typ == LAVAPOOL) ? DB_LAVA : DB_MOAT;
 
     liquid_flow:
+        mark_terrain_changed(level);
         if (ttmp)
             delfloortrap(level, ttmp);
         /* if any objects were frozen here, they're released now */
@@ -909,6 +914,7 @@ dig_up_grave(const struct monst *mon)
         break;
     }
     level->locations[m_mx(mon)][m_my(mon)].typ = ROOM;
+    mark_terrain_changed(level);
     del_engr_at(level, m_mx(mon), m_my(mon));
     newsym(m_mx(mon), m_my(mon));
     return;
@@ -1221,14 +1227,17 @@ mdig_tunnel(struct monst *mtmp)
     int pile = rnd(12);
 
     here = &level->locations[mtmp->mx][mtmp->my];
-    if (here->typ == SDOOR)
+    if (here->typ == SDOOR) {
         cvt_sdoor_to_door(here, &mtmp->dlevel->z);      /* ->typ = DOOR */
+        mark_terrain_changed(level);
+    }
 
     /* Eats away door if present & closed or locked */
     if (closed_door(level, mtmp->mx, mtmp->my)) {
         if (*in_rooms(level, mtmp->mx, mtmp->my, SHOPBASE))
             add_damage(mtmp->mx, mtmp->my, 0L);
         unblock_point(mtmp->mx, mtmp->my);      /* vision */
+        mark_terrain_changed(level);
         if (here->flags & D_TRAPPED) {
             here->flags = D_NODOOR;
             if (mb_trapped(mtmp)) {     /* mtmp is killed */
@@ -1278,6 +1287,7 @@ mdig_tunnel(struct monst *mtmp)
             mksobj_at((pile == 1) ? BOULDER : ROCK, level, mtmp->mx, mtmp->my,
                       TRUE, FALSE, rng_main);
     }
+    mark_terrain_changed(level);
     newsym(mtmp->mx, mtmp->my);
     if (!sobj_at(BOULDER, level, mtmp->mx, mtmp->my))
         unblock_point(mtmp->mx, mtmp->my);      /* vision */
@@ -1398,6 +1408,7 @@ zap_dig(struct monst *mon, struct obj *obj, schar dx, schar dy, schar dz)
                 watch_warn(NULL, zx, zy, TRUE);
             room->flags = D_NODOOR;
             unblock_point(zx, zy);      /* vision */
+            mark_terrain_changed(level);
             digdepth -= 2;
             if (maze_dig)
                 break;
@@ -1412,6 +1423,7 @@ zap_dig(struct monst *mon, struct obj *obj, schar dx, schar dy, schar dz)
                     }
                     room->typ = ROOM;
                     unblock_point(zx, zy);      /* vision */
+                    mark_terrain_changed(level);
                 } else if (!blind(&youmonst) && (you || vis))
                     pline(you ? msgc_failcurse : msgc_monneutral,
                           "The wall glows then fades.");
@@ -1420,6 +1432,7 @@ zap_dig(struct monst *mon, struct obj *obj, schar dx, schar dy, schar dz)
                 if (!(room->flags & W_NONDIGGABLE)) {
                     room->typ = ROOM;
                     unblock_point(zx, zy);      /* vision */
+                    mark_terrain_changed(level);
                 } else if (!blind(&youmonst) && (you || vis))
                     pline(you ? msgc_failcurse : msgc_monneutral,
                           "The tree shudders but is unharmed.");
@@ -1428,6 +1441,7 @@ zap_dig(struct monst *mon, struct obj *obj, schar dx, schar dy, schar dz)
                 if (!(room->flags & W_NONDIGGABLE)) {
                     room->typ = CORR;
                     unblock_point(zx, zy);      /* vision */
+                    mark_terrain_changed(level);
                 } else if (!blind(&youmonst) && (you || vis))
                     pline(you ? msgc_failcurse : msgc_monneutral,
                           "The rock glows then fades.");
@@ -1458,6 +1472,7 @@ zap_dig(struct monst *mon, struct obj *obj, schar dx, schar dy, schar dz)
                 digdepth--;
             }
             unblock_point(zx, zy);      /* vision */
+            mark_terrain_changed(level);
         }
         zx += dx;
         zy += dy;
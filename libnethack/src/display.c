@@ -830,7 +830,10 @@ newsym_core(int x, int y, boolean reroll_hallucinated_appearances)
 void
 newsym(int x, int y)
 {
+    /* newsym_core asks about the monster here several times over */
+    begin_sensing_scope();
     newsym_core(x, y, FALSE);
+    end_sensing_scope();
 }
 
 /*
@@ -1191,6 +1194,9 @@ see_monsters(boolean reroll_hallucinated_appearances)
     if (!level)
         return; /* can be called during startup, before any level exists */
 
+    /* drawing doesn't change what can sense what; in particular, this saves
+       rechecking every segment of a long worm for each segment drawn */
+    begin_sensing_scope();
     for (mon = level->monlist; mon; mon = mon->nmon) {
         if (DEADMONSTER(mon))
             continue;
@@ -1202,6 +1208,7 @@ see_monsters(boolean reroll_hallucinated_appearances)
     /* when mounted, hero's location gets caught by monster loop */
     if (!u.usteed)
         newsym(u.ux, u.uy);
+    end_sensing_scope();
 }
 
 /*
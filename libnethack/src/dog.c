@@ -284,6 +284,7 @@ mon_arrive(struct monst *mtmp, boolean with_you)
     clear_pet_loops(mtmp);
     mtmp->nmon = level->monlist;
     level->monlist = mtmp;
+    index_monst(mtmp);
     if (mx_eshk(mtmp))
         set_residency(mtmp, FALSE);
 
@@ -574,7 +574,7 @@ dog_goal(struct monst *mon, struct edog *edog, int after, int udist,
 #define DDIST(x,y) (distmin(x,y,omx,omy))
 #define SQSRCHRADIUS 5
         int min_x, max_x, min_y, max_y;
-        int nx, ny;
+        int nx, ny, nearby;
         boolean can_use = FALSE;
 
         gtyp = df_nofood;   /* no goal as yet */
@@ -589,11 +589,15 @@ dog_goal(struct monst *mon, struct edog *edog, int after, int udist,
         if ((max_y = omy + SQSRCHRADIUS) >= ROWNO)
             max_y = ROWNO - 1;
 
-        /* nearby food is the first choice, then other objects */
-        for (obj = level->objlist; obj; obj = obj->nobj) {
+        /* nearby food is the first choice, then other objects. These have to
+           be looked at in objlist order (dogfood() uses the RNG), but we can
+           stop as soon as we've seen all the nearby ones. */
+        nearby = floor_objects_in_range(level, omx, omy, SQSRCHRADIUS);
+        for (obj = level->objlist; obj && nearby; obj = obj->nobj) {
             nx = obj->ox;
             ny = obj->oy;
             if (nx >= min_x && nx <= max_x && ny >= min_y && ny <= max_y) {
+                nearby--;
                 otyp = dogfood(mon, obj);
                 if (edog->hungrytime >+ moves + DOG_SATIATED)
                     otyp = df_nofood;
@@ -862,6 +862,7 @@ dokick(const struct nh_cmd_arg *arg)
         if (maploc->typ == SDOOR) {
             if (!levitates(&youmonst) && rn2(30) < avrg_attrib) {
                 cvt_sdoor_to_door(maploc, &u.uz);       /* ->typ = DOOR */
+                mark_terrain_changed(level);
                 pline(msgc_youdiscover, "Crash!  %s a secret door!",
                       /* don't "kick open" when it's locked unless it also
                          happens to be trapped */
@@ -874,6 +875,7 @@ dokick(const struct nh_cmd_arg *arg)
                 } else if (maploc->flags != D_NODOOR &&
                            !(maploc->flags & D_LOCKED))
                     maploc->flags = D_ISOPEN;
+                mark_terrain_changed(level);
                 if (Blind)
                     feel_location(x, y);        /* we know it's gone */
                 else
@@ -891,6 +893,7 @@ dokick(const struct nh_cmd_arg *arg)
                       "Crash!  You kick open a secret passage!");
                 exercise(A_DEX, TRUE);
                 maploc->typ = CORR;
+                mark_terrain_changed(level);
                 if (Blind)
                     feel_location(x, y);        /* we know it's gone */
                 else
@@ -912,6 +915,7 @@ dokick(const struct nh_cmd_arg *arg)
             if ((Luck < 0 || maploc->flags) && kickedloose) {
                 maploc->typ = ROOM;
                 maploc->flags = 0;   /* don't leave loose ends.. */
+                mark_terrain_changed(level);
                 mkgold(goldamt, level, x, y, rng_main);
                 if (Blind)
                     pline(msgc_substitute, "CRASH!  You destroy it.");
@@ -1184,6 +1188,7 @@ dokick(const struct nh_cmd_arg *arg)
             exercise(A_STR, TRUE);
             maploc->flags = D_BROKEN;
         }
+        mark_terrain_changed(level);
         if (Blind)
             feel_location(x, y);        /* we know we broke it */
         else
@@ -378,6 +378,7 @@ make_engr_at(struct level *lev, int x, int y, const char *s, long e_time,
 
     engr_len = strlen(s);
 
+    mark_level_dirty(lev);
     if ((ep = engr_at(lev, x, y)) != 0)
         del_engr(ep, lev);
     ep = newengr(engr_len + 1);
@@ -1326,6 +1327,7 @@ rest_engravings(struct memfile *mf, struct level *lev)
 void
 del_engr(struct engr *ep, struct level *lev)
 {
+    mark_level_dirty(lev);
     if (ep == lev->lev_engr) {
         lev->lev_engr = ep->nxt_engr;
     } else {
@@ -1413,6 +1415,7 @@ make_grave(struct level *lev, int x, int y, const char *str)
 
     /* Make the grave */
     lev->locations[x][y].typ = GRAVE;
+    mark_terrain_changed(lev);
 
     /* Engrave the headstone. */
     if (!str)
@@ -719,10 +719,18 @@ change_fd_lock(int fd, boolean on_logfile, enum locktype type, int timeout)
     if (fd == -1)
         return FALSE;
 
+    /* Whatever we'd read from the file might be changed by someone else once
+       our lock changes. */
+    discard_log_read_buffer();                  /* discard_... is safe */
+
     if (type == LT_MONITOR && !on_logfile)
         panic("Attempt to monitor lock something other than the logfile");
 
     if (on_logfile) {
+        /* Anything we queued to be written to the log must be written while
+           we still have the lock we had when we queued it. */
+        wait_for_log_writer();
+
         /* Set our SIGRTMIN+0..4 handlers based on the lock type. */
         if (type == LT_NONE) {
             signal(SIGRTMIN+0, SIG_IGN);              /* signal is safe */
@@ -1002,6 +1010,8 @@ change_fd_lock(int fd, boolean on_logfile, enum locktype type, int timeout)
     if (fd == -1)
         return FALSE;
 
+    discard_log_read_buffer();
+
     if (type == LT_MONITOR && !on_logfile)
         panic("Attempt to monitor lock something other than the logfile");
 
@@ -1047,6 +1057,8 @@ change_fd_lock(int fd, boolean on_logfile, enum locktype type, int timeout)
     if (fd == -1)
         return FALSE;
 
+    discard_log_read_buffer();
+
     hFile = (HANDLE) _get_osfhandle(fd);
 
     UnlockFile(hFile, 0, 0, 64, 0); /* prevent issues with recursive locks */
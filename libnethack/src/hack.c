@@ -12,9 +12,11 @@ static void maybe_wail(void);
 static boolean moverock(schar dx, schar dy);
 static int still_chewing(xchar, xchar);
 static void dosinkfall(void);
+static void init_travel_grid(void);
 static boolean findtravelpath(boolean(*)(int, int), schar *, schar *);
 static struct monst *monstinroom(const struct permonst *, int);
 static boolean check_interrupt(struct monst *mtmp);
+static boolean interrupting_monster_nearby(void);
 static boolean couldsee_func(int, int);
 
 static void move_update(boolean);
@@ -691,6 +693,7 @@ still_chewing(xchar x, xchar y)
         loc->typ = CORR;
     }
 
+    mark_terrain_changed(level);
     unblock_point(x, y);        /* vision */
     newsym(x, y);
     if (digtxt)
@@ -1083,6 +1086,84 @@ test_move(int ux, int uy, int dx, int dy, int dz, int mode,
     return TRUE;
 }
 
+/* Scratch space for the travel and autoexplore searches of a single step.
+
+   findtravelpath() asks test_move() about the same moves many times over:
+   once or twice per direction from each square it expands, again when it
+   repeats a square to wait out a slow move, again in the second pass after
+   guessing a target, and again when a travel falls back to guessing. None of
+   the TEST_ modes have side effects, and nothing they look at changes until
+   the player acts, so each answer is worked out once per step and kept in
+   moves[][][]. The map changes between steps in too many ways to keep the
+   answers any longer than that, and a stale answer would change where the
+   player goes.
+
+   stepped_near[][] similarly records, for unexplored(), whether any square
+   around each square has been stepped on; it's filled in on first use in a
+   step. */
+#define TM_SLOW_KNOWN 0x01
+#define TM_SLOW       0x02
+#define TM_TRAV_KNOWN 0x04
+#define TM_TRAV       0x08
+
+static struct {
+    struct test_move_cache cache;
+    uchar moves[COLNO][ROWNO][8];       /* TM_ bits, indexed by xdir */
+    boolean stepped_near_valid;
+    boolean stepped_near[COLNO][ROWNO];
+    unsigned travel[COLNO][ROWNO];
+    xchar travelstepx[2][COLNO * ROWNO];
+    xchar travelstepy[2][COLNO * ROWNO];
+} travel_grid;
+
+/* Must be called before each step's calls to findtravelpath(). */
+static void
+init_travel_grid(void)
+{
+    init_test_move_cache(&travel_grid.cache);
+    memset(travel_grid.moves, 0, sizeof travel_grid.moves);
+    travel_grid.stepped_near_valid = FALSE;
+}
+
+/* test_move(x, y, xdir[dir], ydir[dir], 0, mode, ...), for mode TEST_SLOW or
+   TEST_TRAV, remembered for the rest of the step. */
+static boolean
+travel_move(int x, int y, int dir, int mode)
+{
+    uchar *known = &travel_grid.moves[x][y][dir];
+    uchar knownbit = mode == TEST_SLOW ? TM_SLOW_KNOWN : TM_TRAV_KNOWN;
+    uchar legalbit = mode == TEST_SLOW ? TM_SLOW : TM_TRAV;
+
+    if (!(*known & knownbit)) {
+        *known |= knownbit;
+        if (test_move(x, y, xdir[dir], ydir[dir], 0, mode, &travel_grid.cache))
+            *known |= legalbit;
+    }
+    return !!(*known & legalbit);
+}
+
+/* Whether the player has stepped on (x, y) or any square next to it. */
+static boolean
+stepped_near(int x, int y)
+{
+    int i, j, k, l;
+
+    if (!travel_grid.stepped_near_valid) {
+        memset(travel_grid.stepped_near, 0, sizeof travel_grid.stepped_near);
+        for (i = 0; i < COLNO; i++)
+            for (j = 0; j < ROWNO; j++) {
+                if (!level->locations[i][j].mem_stepped)
+                    continue;
+                for (k = -1; k <= 1; k++)
+                    for (l = -1; l <= 1; l++)
+                        if (isok(i + k, j + l))
+                            travel_grid.stepped_near[i + k][j + l] = TRUE;
+            }
+        travel_grid.stepped_near_valid = TRUE;
+    }
+    return travel_grid.stepped_near[x][y];
+}
+
 /* Returns whether a square might be interesting to autoexplore onto. This is
    done purely in terms of the memory of the square, i.e. information the player
    knows already, to avoid leaking information. The algorithm is taken from
@@ -1092,7 +1173,7 @@ test_move(int ux, int uy, int dx, int dy, int dz, int mode,
 static boolean
 unexplored(int x, int y)
 {
-    int i, j, k, l;
+    int i, j;
     const struct trap *ttmp;
     int mem_bg;
 
@@ -1138,17 +1219,9 @@ unexplored(int x, int y)
             if (mem_bg == S_corr && i && j)
                 continue;
             if (isok(x + i, y + j) &&
-                level->locations[x + i][y + j].mem_bg == S_unexplored) {
-                int flag = TRUE;
-
-                for (k = -1; k <= 1; k++)
-                    for (l = -1; l <= 1; l++)
-                        if (isok(x + i + k, y + j + l) &&
-                            level->locations[x + i + k][y + j + l].mem_stepped)
-                            flag = FALSE;
-                if (flag)
-                    return TRUE;
-            }
+                level->locations[x + i][y + j].mem_bg == S_unexplored &&
+                !stepped_near(x + i, y + j))
+                return TRUE;
         }
     return FALSE;
 }
@@ -1183,6 +1256,186 @@ autotravel_weighting(int x, int y, unsigned distance)
     return distance * 10;
 }
 
+/* Distance fields for distmap(). Monsters that move the same way towards the
+   same goal get the same answers, so the partially expanded breadth-first
+   searches are kept in a small cache and shared, both between monsters and
+   from turn to turn.
+
+   A field is only reused while nothing goodpos() looks at has changed on its
+   level. Any code that changes the terrain of a level (the typ of a square,
+   whether a door is closed, and so on) must call mark_terrain_changed() on it;
+   boulders coming and going are handled by place_object() and
+   remove_object(). In wizard mode, each lookup is checked against a copy of
+   the terrain to catch missing calls. */
+#define DISTMAP_FIELDS 16
+
+struct distmap_field {
+    const struct level *lev;
+    unsigned terrain;   /* lev->terrain_generation; 0 if never to be reused */
+    xchar goalx, goaly;
+    unsigned mclass;    /* distmap_class() of the monsters using it */
+    unsigned serial;    /* changes each time this slot is reused */
+    unsigned lastuse;
+    struct monst *mon;  /* whoever used it last, for goodpos() */
+    int onmap[COLNO][ROWNO];
+    boolean goodpos_cached[COLNO][ROWNO];
+    boolean goodpos[COLNO][ROWNO];
+    xchar travelstepx[2][COLNO * ROWNO];
+    xchar travelstepy[2][COLNO * ROWNO];
+    int curdist;
+    int tslen;
+    boolean exhausted;  /* the search is complete; curdist is its last layer */
+};
+
+static struct distmap_field distmap_fields[DISTMAP_FIELDS];
+static unsigned distmap_serial, distmap_clock, distmap_generation;
+
+static struct {
+    const struct level *lev;
+    unsigned generation;
+    unsigned square[COLNO][ROWNO];
+} distmap_terrain;
+
+void
+mark_terrain_changed(struct level *lev)
+{
+    if (lev)
+        lev->terrain_generation = 0;
+}
+
+/* Returns lev's terrain generation, allocating a new one if it changed. */
+static unsigned
+distmap_terrain_generation(struct level *lev)
+{
+    int i;
+
+    if (lev->terrain_generation)
+        return lev->terrain_generation;
+
+    if (!++distmap_generation) {
+        /* 0 means "never reuse", so start again from 1, forgetting everything
+           that was given a generation before */
+        for (i = 0; i < DISTMAP_FIELDS; i++)
+            distmap_fields[i].terrain = 0;
+        for (i = 0; i < MAXLINFO; i++)
+            if (levels[i])
+                levels[i]->terrain_generation = 0;
+        distmap_generation = 1;
+    }
+    return lev->terrain_generation = distmap_generation;
+}
+
+/* Everything about a square that goodpos() can look at when monsters are
+   ignored. */
+static unsigned
+distmap_square(struct level *lev, int x, int y)
+{
+    const struct rm *loc = &lev->locations[x][y];
+    unsigned flags = 0;
+
+    if (IS_STWALL(loc->typ))
+        flags = loc->flags & (W_NONDIGGABLE | W_NONPASSWALL);
+    else if (IS_DOOR(loc->typ))
+        flags = loc->flags & (D_LOCKED | D_CLOSED);
+    else if (loc->typ == DRAWBRIDGE_UP)
+        flags = loc->flags & DB_UNDER;
+
+    return ((unsigned)(unsigned char)loc->typ << 8) | flags |
+        (sobj_at(BOULDER, lev, x, y) ? 0x80 : 0);
+}
+
+/* Wizard mode check that nothing has changed the terrain of lev without
+   calling mark_terrain_changed(). */
+static void
+check_distmap_terrain(struct level *lev)
+{
+    boolean changed = FALSE;
+    boolean fresh = lev != distmap_terrain.lev ||
+        lev->terrain_generation != distmap_terrain.generation;
+    int x, y;
+
+    for (x = 0; x < COLNO; x++)
+        for (y = 0; y < ROWNO; y++) {
+            unsigned square = distmap_square(lev, x, y);
+
+            if (!fresh && square != distmap_terrain.square[x][y])
+                changed = TRUE;
+            distmap_terrain.square[x][y] = square;
+        }
+
+    if (changed) {
+        impossible("Terrain changed without mark_terrain_changed()");
+        mark_terrain_changed(lev);
+        distmap_terrain_generation(lev);
+    }
+    distmap_terrain.lev = lev;
+    distmap_terrain.generation = lev->terrain_generation;
+}
+
+/* Everything about a monster and the goodpos() flags that affects which
+   squares goodpos() allows it onto when monsters are ignored. */
+static unsigned
+distmap_class(const struct monst *mon, int mmflags)
+{
+    const struct permonst *mdat = mon->data;
+
+    return ((unsigned)mmflags << 8) |
+        (pm_phasing(mdat) ? 0x01 : 0) | (is_flyer(mdat) ? 0x02 : 0) |
+        (pm_swims(mdat) ? 0x04 : 0) | (is_clinger(mdat) ? 0x08 : 0) |
+        (likes_lava(mdat) ? 0x10 : 0) | (amorphous(mdat) ? 0x20 : 0) |
+        (throws_rocks(mdat) ? 0x40 : 0) | (mdat->mlet == S_EEL ? 0x80 : 0);
+}
+
+/* Finds or makes the field that ds should use. */
+static struct distmap_field *
+distmap_field(struct distmap_state *ds)
+{
+    struct level *lev = ds->mon->dlevel;
+    unsigned mclass = distmap_class(ds->mon, ds->mmflags);
+    unsigned terrain = 0;
+    struct distmap_field *field, *oldest = &distmap_fields[0];
+    int i;
+
+    /* Without MM_IGNOREMONST, goodpos() also depends on where everyone is. */
+    if ((ds->mmflags & MM_IGNOREMONST) && ds->mon != &youmonst) {
+        terrain = distmap_terrain_generation(lev);
+        if (flags.debug) {
+            check_distmap_terrain(lev);
+            terrain = lev->terrain_generation;
+        }
+    }
+
+    for (i = 0; i < DISTMAP_FIELDS; i++) {
+        field = &distmap_fields[i];
+        if (terrain && field->terrain == terrain && field->lev == lev &&
+            field->goalx == ds->goalx && field->goaly == ds->goaly &&
+            field->mclass == mclass)
+            return field;
+        if (field->lastuse < oldest->lastuse)
+            oldest = field;
+    }
+
+    field = oldest;
+    field->lev = lev;
+    field->terrain = terrain;
+    field->goalx = ds->goalx;
+    field->goaly = ds->goaly;
+    field->mclass = mclass;
+    field->serial = ++distmap_serial;
+
+    memset(field->onmap, 0, sizeof field->onmap);
+    memset(field->goodpos, 0, sizeof field->goodpos);
+    memset(field->goodpos_cached, 0, sizeof field->goodpos_cached);
+
+    field->curdist = 0;
+    field->tslen = 1;
+    field->exhausted = FALSE;
+
+    field->travelstepx[0][0] = ds->goalx;
+    field->travelstepy[0][0] = ds->goaly;
+    return field;
+}
+
 /* Sort-of like findtravelpath, but simplified. This is for monster travel.
    Assumption: monsters know the layout of the dungeon, but not the locations of
    items. Monsters will avoid the square they believe the player to be on. The
@@ -1190,15 +1443,10 @@ autotravel_weighting(int x, int y, unsigned distance)
 void
 distmap_init(struct distmap_state *ds, int x1, int y1, struct monst *mtmp)
 {
-    memset(ds->onmap, 0, sizeof ds->onmap);
-    memset(ds->goodpos, 0, sizeof ds->goodpos);
-    memset(ds->goodpos_cached, 0, sizeof ds->goodpos_cached);
-
-    ds->curdist = 0;
-    ds->tslen = 1;
-
-    ds->travelstepx[0][0] = x1;
-    ds->travelstepy[0][0] = y1;
+    ds->goalx = x1;
+    ds->goaly = y1;
+    ds->field = NULL;
+    ds->layers = 0;
 
     ds->mon = mtmp;
     ds->mmflags = MM_IGNOREMONST;
@@ -1215,46 +1463,72 @@ distmap_init(struct distmap_state *ds, int x1, int y1, struct monst *mtmp)
 int
 distmap(struct distmap_state *ds, int x2, int y2)
 {
-    do {
-        if (ds->onmap[x2][y2])
-            return ds->onmap[x2][y2] - 1;
+    struct distmap_field *f = ds->field;
+
+    /* The field is looked up on first use, rather than in distmap_init, so
+       that the caller can adjust mmflags in between; and again if another
+       search has since taken over its slot. */
+    if (!f || f->serial != ds->serial) {
+        f = ds->field = distmap_field(ds);
+        ds->serial = f->serial;
+    }
+    f->lastuse = ++distmap_clock;
+    f->mon = ds->mon;
 
-        int oldtslen = ds->tslen;
-        ds->tslen = 0;
+    while (!f->onmap[x2][y2] && !f->exhausted) {
+        int oldtslen = f->tslen;
+        f->tslen = 0;
 
         int i;
         for (i = 0; i < oldtslen; i++) {
-            int x = ds->travelstepx[ds->curdist % 2][i];
-            int y = ds->travelstepy[ds->curdist % 2][i];
-            if (ds->onmap[x][y])
+            int x = f->travelstepx[f->curdist % 2][i];
+            int y = f->travelstepy[f->curdist % 2][i];
+            if (f->onmap[x][y])
                 continue;
 
-            ds->onmap[x][y] = ds->curdist + 1;
+            f->onmap[x][y] = f->curdist + 1;
 
             int dx, dy;
             for (dy = -1; dy <= 1; dy++)
                 for (dx = -1; dx <= 1; dx++) {
                     if (!isok(x + dx, y + dy))
                         continue;
-                    if (!ds->goodpos_cached[x + dx][y + dy]) {
-                        ds->goodpos_cached[x + dx][y + dy] = TRUE;
-                        ds->goodpos[x + dx][y + dy] =
-                            goodpos(ds->mon->dlevel, x + dx, y + dy,
-                                    ds->mon, ds->mmflags);
+                    if (!f->goodpos_cached[x + dx][y + dy]) {
+                        f->goodpos_cached[x + dx][y + dy] = TRUE;
+                        f->goodpos[x + dx][y + dy] =
+                            goodpos(f->mon->dlevel, x + dx, y + dy,
+                                    f->mon, ds->mmflags);
                     }
-                    if (!ds->goodpos[x + dx][y + dy])
+                    if (!f->goodpos[x + dx][y + dy])
                         continue;
 
-                    ds->travelstepx[(ds->curdist + 1) % 2][ds->tslen] = x + dx;
-                    ds->travelstepy[(ds->curdist + 1) % 2][ds->tslen] = y + dy;
-                    ds->tslen++;
+                    f->travelstepx[(f->curdist + 1) % 2][f->tslen] = x + dx;
+                    f->travelstepy[(f->curdist + 1) % 2][f->tslen] = y + dy;
+                    f->tslen++;
                 }
         }
 
-        if (ds->tslen)
-            ds->curdist++;
-    } while (ds->tslen);
+        if (f->tslen)
+            f->curdist++;
+        else
+            f->exhausted = TRUE;
+    }
+
+    /* The answers are those of a search of ds's own, which would have
+       expanded only as far as ds's queries so far needed: a square within
+       that gets its distance, as does one that needed another layer, unless
+       that layer was the last, when the search stopped without looking at
+       it. */
+    int dist = f->onmap[x2][y2] - 1;
+
+    if (dist >= 0 && dist < ds->layers)
+        return dist;
+    if (dist >= 0 && !(f->exhausted && dist == f->curdist)) {
+        ds->layers = dist + 1;
+        return dist;
+    }
 
+    ds->layers = f->curdist + 1;
     return COLNO * ROWNO; /* sentinel */
 }
 
@@ -1269,8 +1543,8 @@ distmap(struct distmap_state *ds, int x2, int y2)
 static boolean
 findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
 {
-    struct test_move_cache cache;
-    init_test_move_cache(&cache);
+    const struct test_move_cache *cache = &travel_grid.cache;
+
     /* If a travel command is sent to an adjacent, reachable location
        (i.e. continue_message is TRUE, meaning that this isn't an implicitly
        continued action), use normal movement rules. This is for mouse-driven
@@ -1281,7 +1555,7 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
     if (!guess && turnstate.continue_message &&
         distmin(u.ux, u.uy, u.tx, u.ty) == 1) {
         if (test_move(u.ux, u.uy, u.tx - u.ux, u.ty - u.uy, 0,
-                      TEST_MOVE, &cache)) {
+                      TEST_MOVE, cache)) {
             *dx = u.tx - u.ux;
             *dy = u.ty - u.uy;
             action_completed();
@@ -1290,9 +1564,9 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
         }
     }
     if (u.tx != u.ux || u.ty != u.uy || guess == unexplored) {
-        unsigned travel[COLNO][ROWNO];
-        xchar travelstepx[2][COLNO * ROWNO];
-        xchar travelstepy[2][COLNO * ROWNO];
+        unsigned (*travel)[ROWNO] = travel_grid.travel;
+        xchar (*travelstepx)[COLNO * ROWNO] = travel_grid.travelstepx;
+        xchar (*travelstepy)[COLNO * ROWNO] = travel_grid.travelstepy;
         xchar tx, ty, ux, uy;
         int n = 1;      /* max offset in travelsteps */
         int set = 0;    /* two sets current and previous */
@@ -1315,7 +1589,7 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
         }
 
     noguess:
-        memset(travel, 0, sizeof (travel));
+        memset(travel_grid.travel, 0, sizeof travel_grid.travel);
         travelstepx[0][0] = tx;
         travelstepy[0][0] = ty;
 
@@ -1376,7 +1650,7 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
                         (guess == couldsee_func && !guess(nx, ny)))
                         continue;
 
-                    if (test_move(x, y, nx - x, ny - y, 0, TEST_SLOW, &cache)) {
+                    if (travel_move(x, y, ordered[dir], TEST_SLOW)) {
                         /* closed doors and boulders usually cause a delay, so
                            prefer another path */
                         if ((int)travel[x][y] > radius - 5) {
@@ -1390,10 +1664,10 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
                             continue;
                         }
                     }
-                    if (test_move(x, y, nx - x, ny - y, 0, TEST_SLOW, &cache) ||
-                        test_move(x, y, nx - x, ny - y, 0, TEST_TRAV, &cache)) {
+                    if (travel_move(x, y, ordered[dir], TEST_SLOW) ||
+                        travel_move(x, y, ordered[dir], TEST_TRAV)) {
                         if ((level->locations[nx][ny].seenv ||
-                             (!cache.blind && couldsee(nx, ny)))) {
+                             (!cache->blind && couldsee(nx, ny)))) {
                             if (nx == ux && ny == uy) {
                                 if (!guess) {
                                     *dx = x - ux;
@@ -1466,7 +1740,7 @@ findtravelpath(boolean(*guess) (int, int), schar *dx, schar *dy)
                     action_completed();
                     return FALSE;
                 }
-                if (test_move(u.ux, u.uy, *dx, *dy, 0, TEST_MOVE, &cache))
+                if (test_move(u.ux, u.uy, *dx, *dy, 0, TEST_MOVE, cache))
                     return TRUE;
                 goto found;
             }
@@ -1568,6 +1842,7 @@ domove(const struct nh_cmd_arg *arg, enum u_interaction_mode uim,
     }
 
     if (travelling()) {
+        init_travel_grid();
         if (thismove == occ_autoexplore) {
             if (Blind) {
                 pline(msgc_cancelled, "You can't see where you're going!");
@@ -3003,12 +3278,9 @@ lookaround(enum u_interaction_mode uim)
        Exception: item-interactive (i.e. aggressive) farmoves, such as
        shift-direction. */
     if (farmoving && !aggressive_farmoving && flags.travel_interrupt) {
-        for (mtmp = level->monlist; mtmp; mtmp = mtmp->nmon) {
-            if (distmin(u.ux, u.uy, mtmp->mx, mtmp->my) <= (BOLT_LIM + 1) &&
-                couldsee(mtmp->mx, mtmp->my) && check_interrupt(mtmp)) {
-                action_interrupted();
-                return;
-            }
+        if (interrupting_monster_nearby()) {
+            action_interrupted();
+            return;
         }
     }
 
@@ -3194,6 +3466,43 @@ check_interrupt(struct monst *mtmp)
             !onscary(u.ux, u.uy, mtmp) && canspotmon(mtmp));
 }
 
+static boolean
+interrupts_travel(struct monst *mtmp)
+{
+    return distmin(u.ux, u.uy, mtmp->mx, mtmp->my) <= (BOLT_LIM + 1) &&
+        couldsee(mtmp->mx, mtmp->my) && check_interrupt(mtmp);
+}
+
+/* Is there a monster within sight and BOLT_LIM + 1 squares that should stop
+   a travel or run? Which one doesn't matter, so the monsters can come from
+   the tile index rather than the whole monlist. */
+static boolean
+interrupting_monster_nearby(void)
+{
+    struct monst *nearby[(2 * BOLT_LIM + 3) * (2 * BOLT_LIM + 3)];
+    struct monst *mtmp;
+    int i, n;
+
+    /* Monsters that have died but not yet been freed are on the monlist but
+       not on the map, so the index doesn't know about them; the same goes for
+       the steed. */
+    if (level->flags.purge_monsters) {
+        for (mtmp = level->monlist; mtmp; mtmp = mtmp->nmon)
+            if (interrupts_travel(mtmp))
+                return TRUE;
+        return FALSE;
+    }
+    if (u.usteed && interrupts_travel(u.usteed))
+        return TRUE;
+
+    n = monsters_in_range(level, u.ux, u.uy, BOLT_LIM + 1, nearby,
+                          SIZE(nearby));
+    for (i = 0; i < n; i++)
+        if (interrupts_travel(nearby[i]))
+            return TRUE;
+    return FALSE;
+}
+
 
 /* something like lookaround, but we are not running */
 /* react only to monsters that might hit us */
@@ -0,0 +1,192 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* NetHack may be freely redistributed.  See license for details. */
+
+#include "hack.h"
+
+/* Indexes from monster and object IDs to the monster or object itself, so
+   that find_mid() and find_oid() don't have to walk every chain in the game.
+
+   The monster index holds exactly the monsters that are linked into some
+   level's monlist (dead or alive); monsters are added where they get linked
+   in, and removed by relmon() and dealloc_monst().  The object index holds
+   every object that has been given a real ID and not yet deallocated;
+   because objects move between chains far more often than monsters do, the
+   callers check obj->where to find out where an indexed object currently
+   is, rather than keeping the index in step with every chain operation.
+
+   Neither index is saved; they are rebuilt as the chains are restored. */
+
+struct id_entry {
+    unsigned id;
+    void *ptr;
+};
+
+struct id_index {
+    struct id_entry *entries;
+    unsigned size;      /* always 0 or a power of 2 */
+    unsigned count;
+};
+
+static struct id_index monst_index, obj_index;
+
+static unsigned int
+id_hash(unsigned id)
+{
+    /* Fibonacci hashing; IDs are allocated sequentially, and this spreads
+       runs of consecutive IDs evenly over the table. */
+    return (unsigned int)(((unsigned long long)id * 0x9E3779B97F4A7C15ULL)
+                          >> 32);
+}
+
+static void *
+id_find(const struct id_index *idx, unsigned id)
+{
+    unsigned int mask = idx->size - 1;
+    unsigned int slot;
+
+    if (!idx->size)
+        return NULL;
+
+    for (slot = id_hash(id) & mask; idx->entries[slot].ptr;
+         slot = (slot + 1) & mask)
+        if (idx->entries[slot].id == id)
+            return idx->entries[slot].ptr;
+    return NULL;
+}
+
+/* Adds or replaces the entry for id. */
+static void
+id_insert(struct id_index *idx, unsigned id, void *ptr)
+{
+    unsigned int mask, slot;
+
+    /* Keep the load factor at most 1/2. */
+    if ((idx->count + 1) * 2 > idx->size) {
+        struct id_entry *old = idx->entries;
+        unsigned int oldsize = idx->size, i;
+
+        idx->size = oldsize ? oldsize * 2 : 1024;
+        idx->entries = calloc(idx->size, sizeof *idx->entries);
+        if (!idx->entries)
+            panic("Out of memory growing the ID index");
+        mask = idx->size - 1;
+
+        /* The keys in the old index are distinct, so just find empty slots. */
+        for (i = 0; i < oldsize; i++) {
+            if (!old[i].ptr)
+                continue;
+            for (slot = id_hash(old[i].id) & mask; idx->entries[slot].ptr;
+                 slot = (slot + 1) & mask)
+                ;
+            idx->entries[slot] = old[i];
+        }
+        free(old);
+    }
+
+    mask = idx->size - 1;
+    for (slot = id_hash(id) & mask; idx->entries[slot].ptr;
+         slot = (slot + 1) & mask)
+        if (idx->entries[slot].id == id)
+            break;
+    if (!idx->entries[slot].ptr)
+        idx->count++;
+    idx->entries[slot].id = id;
+    idx->entries[slot].ptr = ptr;
+}
+
+/* Removes the entry for id, but only if it currently refers to ptr; a stale
+   removal (e.g. of a monster that has already been replaced by a copy with
+   the same ID) leaves the newer entry alone. */
+static void
+id_remove(struct id_index *idx, unsigned id, const void *ptr)
+{
+    unsigned int mask = idx->size - 1;
+    unsigned int slot, next;
+
+    if (!idx->size)
+        return;
+
+    for (slot = id_hash(id) & mask; idx->entries[slot].ptr;
+         slot = (slot + 1) & mask)
+        if (idx->entries[slot].id == id)
+            break;
+    if (idx->entries[slot].ptr != ptr)
+        return;
+
+    /* Backward-shift deletion: move later members of the probe run into the
+       hole if that brings them no further from their home slot, so that
+       lookups never need tombstones. */
+    for (next = (slot + 1) & mask; idx->entries[next].ptr;
+         next = (next + 1) & mask) {
+        unsigned int home = id_hash(idx->entries[next].id) & mask;
+
+        if (((next - home) & mask) >= ((next - slot) & mask)) {
+            idx->entries[slot] = idx->entries[next];
+            slot = next;
+        }
+    }
+    idx->entries[slot].id = 0;
+    idx->entries[slot].ptr = NULL;
+    idx->count--;
+}
+
+static void
+id_clear(struct id_index *idx)
+{
+    free(idx->entries);
+    idx->entries = NULL;
+    idx->size = 0;
+    idx->count = 0;
+}
+
+
+void
+index_monst(struct monst *mon)
+{
+    if (mon->m_id && mon->m_id != TEMPORARY_IDENT)
+        id_insert(&monst_index, mon->m_id, mon);
+}
+
+void
+unindex_monst(const struct monst *mon)
+{
+    id_remove(&monst_index, mon->m_id, mon);
+}
+
+/* Returns the monster with the given ID that is on some level's monlist, or
+   NULL.  The monster might be dead. */
+struct monst *
+indexed_monst(unsigned id)
+{
+    return id_find(&monst_index, id);
+}
+
+void
+index_obj(struct obj *obj)
+{
+    if (obj->o_id != TEMPORARY_IDENT && obj->memory == OM_NO_MEMORY)
+        id_insert(&obj_index, obj->o_id, obj);
+}
+
+void
+unindex_obj(const struct obj *obj)
+{
+    id_remove(&obj_index, obj->o_id, obj);
+}
+
+/* Returns the live object with the given ID, or NULL; the caller has to
+   check where it is. */
+struct obj *
+indexed_obj(unsigned id)
+{
+    return id_find(&obj_index, id);
+}
+
+void
+clear_id_indexes(void)
+{
+    id_clear(&monst_index);
+    id_clear(&obj_index);
+}
+
+/*idindex.c*/
@@ -24,11 +24,12 @@
  * The major working function is do_light_sources(). It is called when the
  * vision system is recreating its "could see" array.  Here we add a flag
  * (TEMP_LIT) to the array for all locations that are lit via a light source.
- * The bad part of this is that we have to re-calculate the LOS of each light
- * source every time the vision system runs.  Even if the light sources and any
- * topology (vision blocking positions) have not changed.  The good part is that
- * no extra memory is used, plus we don't have to figure out how far the sources
- * have moved, or if the topology has changed.
+ * Each source remembers which squares it lit last time, and only walks its
+ * circle again if it has moved, its range has changed, or the topology (vision
+ * blocking positions) has changed since, as told by clear_path_generation().
+ * The exceptions involve the hero's square, for which clear_path() answers from
+ * the "could see" array being built: it is checked afresh each time, and a
+ * source on the hero's square isn't remembered at all.
  *
  * The structure of the save/restore mechanism is amazingly similar to the timer
  * save/restore.  This is because they both have the same principals of having
@@ -40,6 +41,7 @@
 #define LSF_NEEDS_FIXUP 0x2     /* need oid fixup */
 
 static void write_ls(struct memfile *mf, light_source *);
+static void find_lit_squares(light_source *, char **);
 static int maybe_write_ls(struct memfile *mf, struct level *lev, int range,
                           boolean write_it);
 
@@ -55,6 +57,7 @@ new_light_source(struct level *lev, xchar x, xchar y, int range, int type,
         return;
     }
 
+    mark_level_dirty(lev);
     ls = malloc(sizeof (light_source));
 
     ls->next = lev->lev_lights;
@@ -64,6 +67,7 @@ new_light_source(struct level *lev, xchar x, xchar y, int range, int type,
     ls->type = type;
     ls->id = id;
     ls->flags = 0;
+    ls->lit_generation = 0;
     lev->lev_lights = ls;
 
     turnstate.vision_full_recalc = TRUE;     /* make the source show up */
@@ -100,6 +104,7 @@ del_light_source(struct level *lev, int type, void *id)
             continue;
         if (curr->id ==
                ((curr->flags & LSF_NEEDS_FIXUP) ? (void *)tmp_id : id)) {
+            mark_level_dirty(lev);
             if (prev)
                 prev->next = curr->next;
             else
@@ -117,7 +122,7 @@ del_light_source(struct level *lev, int type, void *id)
 void
 do_light_sources(char **cs_rows)
 {
-    int x, y, min_x, max_x, max_y, offset;
+    int y, max_y, offset;
     const char *limits;
     short at_hero_range = 0;
     light_source *ls;
@@ -152,34 +157,79 @@ do_light_sources(char **cs_rows)
         }
 
         if (ls->flags & LSF_SHOW) {
-            /* 
-             * Walk the points in the circle and see if they are
-             * visible from the center.  If so, mark'em.
-             *
-             * Kevin's tests indicated that doing this brute-force
-             * method is faster for radius <= 3 (or so).
-             */
-            limits = circle_ptr(ls->range);
+            boolean at_hero = ls->x == u.ux && ls->y == u.uy;
+
+            if (at_hero)
+                find_lit_squares(ls, cs_rows);
+            else if (ls->lit_generation != clear_path_generation() ||
+                     ls->lit_x != ls->x || ls->lit_y != ls->y ||
+                     ls->lit_range != ls->range)
+                find_lit_squares(ls, NULL);
+
             if ((max_y = (ls->y + ls->range)) >= ROWNO)
                 max_y = ROWNO - 1;
             if ((y = (ls->y - ls->range)) < 0)
                 y = 0;
             for (; y <= max_y; y++) {
+                uint32_t bits = ls->lit_rows[y - ls->y + ls->range];
+
                 row = cs_rows[y];
-                offset = limits[abs(y - ls->y)];
-                if ((min_x = (ls->x - offset)) < 0)
-                    min_x = 0;
-                if ((max_x = (ls->x + offset)) >= COLNO)
-                    max_x = COLNO - 1;
-
-                for (x = min_x; x <= max_x; x++)
-                    if (clear_path((int)ls->x, (int)ls->y, x, y, cs_rows))
-                        row[x] |= TEMP_LIT;
+                if (y == u.uy && !at_hero && abs(u.ux - ls->x) <= ls->range)
+                    bits &= ~((uint32_t)1 << (u.ux - ls->x + ls->range));
+                while (bits) {
+                    row[ls->x - ls->range + __builtin_ctz(bits)] |= TEMP_LIT;
+                    bits &= bits - 1;
+                }
             }
+
+            /* the hero's square, if it was left out above */
+            limits = circle_ptr(ls->range);
+            offset = abs(u.uy - ls->y);
+            if (!at_hero && offset <= ls->range &&
+                abs(u.ux - ls->x) <= limits[offset] &&
+                clear_path((int)ls->x, (int)ls->y, u.ux, u.uy, cs_rows))
+                cs_rows[u.uy][u.ux] |= TEMP_LIT;
         }
     }
 }
 
+/* Walk the points in the circle around ls and see which are visible from the
+   center, remembering them in ls->lit_rows. Kevin's tests indicated that doing
+   this brute-force method is faster for radius <= 3 (or so).
+
+   cs_rows is passed on to clear_path(); if it's NULL, the answers don't depend
+   on the hero's position and can be reused until the topology changes. */
+static void
+find_lit_squares(light_source *ls, char **cs_rows)
+{
+    int x, y, min_x, max_x, max_y, offset;
+    const char *limits;
+
+    memset(ls->lit_rows, 0, sizeof ls->lit_rows);
+    ls->lit_x = ls->x;
+    ls->lit_y = ls->y;
+    ls->lit_range = ls->range;
+    ls->lit_generation = cs_rows ? 0 : clear_path_generation();
+
+    limits = circle_ptr(ls->range);
+    if ((max_y = (ls->y + ls->range)) >= ROWNO)
+        max_y = ROWNO - 1;
+    if ((y = (ls->y - ls->range)) < 0)
+        y = 0;
+    for (; y <= max_y; y++) {
+        offset = limits[abs(y - ls->y)];
+        if ((min_x = (ls->x - offset)) < 0)
+            min_x = 0;
+        if ((max_x = (ls->x + offset)) >= COLNO)
+            max_x = COLNO - 1;
+
+        for (x = min_x; x <= max_x; x++)
+            if (clear_path((int)ls->x, (int)ls->y, x, y, cs_rows))
+                ls->lit_rows[y - ls->y + ls->range] |=
+                    (uint32_t)1 << (x - ls->x + ls->range);
+    }
+}
+
 /* (mon->mx == COLNO) implies migrating */
 #define mon_is_local(mon) ((mon) != &youmonst && (mon)->mx != COLNO)
 
@@ -190,10 +240,12 @@ find_mid(struct level *lev, unsigned nid, unsigned fmflags)
 
     if (!nid)
         return &youmonst;
-    if (fmflags & FM_FMON)
-        for (mtmp = lev->monlist; mtmp; mtmp = mtmp->nmon)
-            if (!DEADMONSTER(mtmp) && mtmp->m_id == nid)
-                return mtmp;
+    if (fmflags & FM_FMON) {
+        /* the ID index holds exactly the monsters on some level's monlist */
+        mtmp = indexed_monst(nid);
+        if (mtmp && mtmp->dlevel == lev && !DEADMONSTER(mtmp))
+            return mtmp;
+    }
     if (fmflags & FM_MIGRATE)
         for (mtmp = migrating_mons; mtmp; mtmp = mtmp->nmon)
             if (mtmp->m_id == nid)
@@ -245,6 +297,8 @@ transfer_lights(struct level *oldlev, struct level *newlev, unsigned int obj_id)
         }
         /* associate light sources with the new level */
         if (transfer) {
+            mark_level_dirty(oldlev);
+            mark_level_dirty(newlev);
             *prev = curr->next;
             curr->next = newlev->lev_lights;
             newlev->lev_lights = curr;
@@ -319,6 +373,7 @@ restore_light_sources(struct memfile *mf, struct level *lev)
         ls->id = (void *)id;
         ls->x = mread8(mf);
         ls->y = mread8(mf);
+        ls->lit_generation = 0;
 
         ls->next = rest;
         if (prev)
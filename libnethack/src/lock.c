@@ -180,6 +180,7 @@ picklock(void)
             door->flags = D_CLOSED;
         else
             door->flags = D_LOCKED;
+        mark_terrain_changed(level);
 
         /* player now knows the door's open/closed status, and its
            locked/unlocked status, and also that it isn't trapped (it would have
@@ -688,6 +689,7 @@ doopen(const struct nh_cmd_arg *arg)
                 add_damage(cc.x, cc.y, 0L);
         } else
             door->flags = D_ISOPEN;
+        mark_terrain_changed(level);
         if (Blind)
             feel_location(cc.x, cc.y);  /* the hero knows she opened it */
         else
@@ -804,6 +806,7 @@ doclose(const struct nh_cmd_arg *arg)
             pline(msgc_actionok, "The door closes.");
             door->flags = D_CLOSED;
             door->mem_door_l = 1;
+            mark_terrain_changed(level);
             /* map_background here sets the mem_door flags correctly; and it's
                redundant to both feel_location and newsym with a door.
                Exception: if we remember an invisible monster on the door
@@ -880,6 +883,7 @@ doorlock(struct obj * otmp, int x, int y)
         case SPE_FORCE_BOLT:
             door->typ = DOOR;
             door->flags = D_CLOSED | (door->flags & D_TRAPPED);
+            mark_terrain_changed(level);
             newsym(x, y);
             if (cansee(x, y))
                 pline(msgc_youdiscover, "A door appears in the wall!");
@@ -913,6 +917,7 @@ doorlock(struct obj * otmp, int x, int y)
             }
             block_point(x, y);
             door->typ = SDOOR;
+            mark_terrain_changed(level);
             if (vis)
                 pline(msgc_actionok, "The doorway vanishes!");
             newsym(x, y);
@@ -932,6 +937,7 @@ doorlock(struct obj * otmp, int x, int y)
             pline(msgc_yafm,
                   "%s springs up in the doorway and conceals it!", dustcloud);
             door->typ = SDOOR;
+            mark_terrain_changed(level);
             newsym(x, y);
             return TRUE;
         }
@@ -956,6 +962,7 @@ doorlock(struct obj * otmp, int x, int y)
         }
         block_point(x, y);
         door->flags = D_LOCKED | (door->flags & D_TRAPPED);
+        mark_terrain_changed(level);
         newsym(x, y);
         break;
     case WAN_OPENING:
@@ -963,6 +970,7 @@ doorlock(struct obj * otmp, int x, int y)
         if (door->flags & D_LOCKED) {
             msg = "The door unlocks!";
             door->flags = D_CLOSED | (door->flags & D_TRAPPED);
+            mark_terrain_changed(level);
         } else
             res = FALSE;
         break;
@@ -980,12 +988,14 @@ doorlock(struct obj * otmp, int x, int y)
                         You_hear(msgc_levelsound, "a distant explosion.");
                 }
                 door->flags = D_NODOOR;
+                mark_terrain_changed(level);
                 unblock_point(x, y);
                 newsym(x, y);
                 loudness = 40;
                 break;
             }
             door->flags = D_BROKEN;
+            mark_terrain_changed(level);
             if (cansee(x, y))
                 pline(msgc_actionok, "The door crashes open!");
             else
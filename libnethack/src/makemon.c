@@ -49,6 +49,7 @@ newmonst(void)
 void
 dealloc_monst(struct monst *mon)
 {
+    unindex_monst(mon);
     mx_free(mon);
     free(mon);
 }
@@ -766,6 +767,7 @@ clone_mon(struct monst *mon, xchar x, xchar y)
     m2->nmon = level->monlist;
     level->monlist = m2;
     m2->m_id = next_ident();
+    index_monst(m2);
     m2->mx = mm.x;
     m2->my = mm.y;
 
@@ -965,6 +967,7 @@ makemon(const struct permonst *ptr, struct level *lev, int x, int y,
     mtmp->nmon = lev->monlist;
     lev->monlist = mtmp;
     mtmp->m_id = next_ident();
+    index_monst(mtmp);
     set_mon_data(mtmp, ptr);
     /* TODO: monsters with several potential alignments */
     mtmp->maligntyp = (mtmp->data->maligntyp == A_NONE ? A_NONE :
@@ -3,6 +3,13 @@
 /* Copyright (c) Daniel Thaler, 2011.                             */
 /* NetHack may be freely redistributed.  See license for details. */
 
+/* The intrinsics headers must come before hack.h, which defines u. */
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #include "hack.h"
 #define __STDC_FORMAT_MACROS
 #include <stdint.h>
@@ -117,11 +124,19 @@ mnew(struct memfile *mf, struct memfile *relativeto)
 
     mdiffwrite(mf, diffheader, 2);
 
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++)
-        mf->tags[i] = 0;
+    mf->tagchunks = NULL;
+    mf->ntags = 0;
+    mf->tagindex = NULL;
+    mf->tagindex_size = 0;
     mf->last_tag = 0;
 }
 
+static struct memfile_tag *
+mtag_number(const struct memfile *mf, int n)
+{
+    return &mf->tagchunks[n / MEMFILE_TAGCHUNK_SIZE][n % MEMFILE_TAGCHUNK_SIZE];
+}
+
 /* Allocates to as a deep copy of from. */
 void
 mclone(struct memfile *to, const struct memfile *from)
@@ -139,20 +154,27 @@ mclone(struct memfile *to, const struct memfile *from)
         memcpy(to->diffbuf, from->diffbuf, from->difflen);
     }
 
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-        struct memfile_tag *fromtag, **totag;
-
-        fromtag = from->tags[i];
-        totag = &(to->tags[i]);
+    if (from->ntags) {
+        int nchunks = (from->ntags + MEMFILE_TAGCHUNK_SIZE - 1) /
+            MEMFILE_TAGCHUNK_SIZE;
 
-        while (fromtag) {
-            *totag = malloc(sizeof (struct memfile_tag));
-            **totag = *fromtag;
-            fromtag = fromtag->next;
-            totag = &((*totag)->next);
+        to->tagchunks = malloc(nchunks * sizeof *to->tagchunks);
+        for (i = 0; i < nchunks; i++) {
+            to->tagchunks[i] = malloc(MEMFILE_TAGCHUNK_SIZE *
+                                      sizeof (struct memfile_tag));
+            memcpy(to->tagchunks[i], from->tagchunks[i],
+                   MEMFILE_TAGCHUNK_SIZE * sizeof (struct memfile_tag));
         }
 
-        *totag = 0;
+        /* The prev_tag pointers need to point into the copy. */
+        for (i = 0; i < to->ntags; i++)
+            mtag_number(to, i)->prev_tag = i ? mtag_number(to, i - 1) : NULL;
+        to->last_tag = mtag_number(to, to->ntags - 1);
+    }
+    if (from->tagindex) {
+        to->tagindex = malloc(from->tagindex_size * sizeof *to->tagindex);
+        memcpy(to->tagindex, from->tagindex,
+               from->tagindex_size * sizeof *to->tagindex);
     }
 }
 
@@ -165,16 +187,15 @@ mfree(struct memfile *mf)
     mf->buf = 0;
     free(mf->diffbuf);
     mf->diffbuf = 0;
-    for (i = 0; i < MEMFILE_HASHTABLE_SIZE; i++) {
-        struct memfile_tag *tag, *otag;
-
-        for ((tag = mf->tags[i]), (otag = NULL); tag; tag = tag->next) {
-            free(otag);
-            otag = tag;
-        }
-        free(otag);
-        mf->tags[i] = 0;
-    }
+    for (i = 0; i * MEMFILE_TAGCHUNK_SIZE < mf->ntags; i++)
+        free(mf->tagchunks[i]);
+    free(mf->tagchunks);
+    mf->tagchunks = NULL;
+    mf->ntags = 0;
+    free(mf->tagindex);
+    mf->tagindex = NULL;
+    mf->tagindex_size = 0;
+    mf->last_tag = 0;
 }
 
 /* Functions for writing to a memory file.
@@ -211,6 +232,57 @@ mmmap(struct memfile *mf, long len, long off)
     return mf->buf + off;
 }
 
+/* Returns the number of bytes at the start of a and b that are all equal (if
+   equal is TRUE) or all different (if equal is FALSE), up to len. Most of a
+   save is the same as the previous one, so we look at as many bytes at a time
+   as we can. */
+static unsigned int
+mrunlength(const uint8_t *a, const uint8_t *b, unsigned int len, boolean equal)
+{
+    unsigned int i = 0;
+
+#if defined(__AVX2__) && defined(__GNUC__)
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(va, vb));
+
+        if (!equal)
+            mask = ~mask;
+        if (mask != 0xFFFFFFFFU)
+            return i + __builtin_ctz(~mask);
+    }
+#elif defined(__SSE2__) && defined(__GNUC__)
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+
+        if (!equal)
+            mask = ~mask & 0xFFFFU;
+        if (mask != 0xFFFFU)
+            return i + __builtin_ctz(~mask);
+    }
+#else
+    /* A word at a time; we find the exact position bytewise, below. */
+    for (; i + 8 <= len; i += 8) {
+        uint64_t wa, wb, x;
+
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        x = wa ^ wb;
+        if (equal ? x != 0 :
+            ((x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL) != 0)
+            break;
+    }
+#endif
+
+    while (i < len && (a[i] == b[i]) == !!equal)
+        i++;
+    return i;
+}
+
 void
 mwrite(struct memfile *mf, const void *buf, unsigned int num)
 {
@@ -220,28 +292,47 @@ mwrite(struct memfile *mf, const void *buf, unsigned int num)
     if (!mf->relativeto) {
         mf->pos += num;
     } else {
-        /* calculate and record the diff as well */
-        while (num--) {
-            if (mf->relativepos < mf->relativeto->pos &&
-                mf->buf[mf->pos] == mf->relativeto->buf[mf->relativepos]) {
+        /* Calculate and record the diff as well. Each byte is a copy if it
+           matches the corresponding byte of the file we're relative to, and an
+           edit otherwise; we handle a run of copies or of edits at a time. */
+        while (num) {
+            const uint8_t *newdata = (const uint8_t *)mf->buf + mf->pos;
+            const uint8_t *olddata =
+                (const uint8_t *)mf->relativeto->buf + mf->relativepos;
+            unsigned int comparable = 0, run;
+
+            if (mf->relativepos < mf->relativeto->pos) {
+                comparable = mf->relativeto->pos - mf->relativepos;
+                if (comparable > num)
+                    comparable = num;
+            }
+
+            run = mrunlength(newdata, olddata, comparable, TRUE);
+            if (run) {
 
                 if (mf->pending_seeks || mf->pending_edits)
                     mdiffflush(mf, 0);
 
-                mf->pending_copies++;
+                mf->pending_copies += run;
 
             } else {
 
+                /* Anything past the end of the other file is an edit. */
+                run = mrunlength(newdata, olddata, comparable, FALSE);
+                if (run == comparable)
+                    run = num;
+
                 /* Note that mdiffflush is responsible for writing the actual
                    data that was edited, once we have a complete run of it. So
                    there's no need to record the data anywhere but in buf. */
                 if (mf->pending_seeks)
                     mdiffflush(mf, 0);
 
-                mf->pending_edits++;
+                mf->pending_edits += run;
             }
-            mf->pos++;
-            mf->relativepos++;
+            mf->pos += run;
+            mf->relativepos += run;
+            num -= run;
         }
     }
 }
@@ -765,10 +856,10 @@ mhint_mon_coordinates(struct memfile *mf)
 
    If something goes wrong, calls errfunction with an error message and diff as
    arguments. */
-void
-mdiffapply(char *diff, long difflen, struct memfile *diff_base,
-           struct memfile *new_memfile,
-           void (*errfunction)(const char *, char *))
+static void
+mdiffapply_core(char *diff, long difflen, struct memfile *diff_base,
+                struct memfile *new_memfile,
+                void (*errfunction)(const char *, char *))
 {
     char *mfp;
     unsigned char *bufp = (unsigned char *)diff;
@@ -1181,30 +1272,117 @@ mdiffapply(char *diff, long difflen, struct memfile *diff_base,
     }
 }
 
+void
+mdiffapply(char *diff, long difflen, struct memfile *diff_base,
+           struct memfile *new_memfile,
+           void (*errfunction)(const char *, char *))
+{
+    unsigned long long start = profile_start();
+
+    mdiffapply_core(diff, difflen, diff_base, new_memfile, errfunction);
+    profile_stop(NHPROF_MDIFFAPPLY, start);
+}
+
 /* Tagging memfiles. This remembers the correspondence between the tag
    and the file location. For a diff memfile, it also sets relativepos
    to the pos of the tag in relativeto, if it exists, and adds a seek
    command to the diff, unless it would be redundant. */
+static unsigned int
+mtag_hash(long tagdata, enum memfile_tagtype tagtype)
+{
+    unsigned long long h = ((unsigned long long)tagdata << 8) ^
+        (unsigned long long)tagtype;
+
+    /* Fibonacci hashing: the top bits of the product are well mixed. */
+    return (h * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+/* Returns the most recent tag in mf with the given key, or NULL. */
+static struct memfile_tag *
+mtag_find(const struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
+{
+    unsigned int mask = mf->tagindex_size - 1;
+    unsigned int slot;
+
+    if (!mf->tagindex_size)
+        return NULL;
+
+    for (slot = mtag_hash(tagdata, tagtype) & mask; mf->tagindex[slot];
+         slot = (slot + 1) & mask) {
+        struct memfile_tag *tag = mtag_number(mf, mf->tagindex[slot] - 1);
+
+        if (tag->tagtype == tagtype && tag->tagdata == tagdata)
+            return tag;
+    }
+    return NULL;
+}
+
+/* Adds tag number n to the index, replacing any older tag with the same key. */
+static void
+mtag_index(struct memfile *mf, int n)
+{
+    struct memfile_tag *tag = mtag_number(mf, n);
+    unsigned int mask, slot;
+
+    /* Keep the load factor at most 1/2. */
+    if (mf->ntags * 2 > mf->tagindex_size) {
+        int *oldindex = mf->tagindex;
+        int oldsize = mf->tagindex_size, i;
+
+        mf->tagindex_size = oldsize ? oldsize * 2 : 1024;
+        mf->tagindex = calloc(mf->tagindex_size, sizeof *mf->tagindex);
+        mask = mf->tagindex_size - 1;
+
+        /* The keys in the old index are distinct, so just find empty slots. */
+        for (i = 0; i < oldsize; i++) {
+            struct memfile_tag *otag;
+
+            if (!oldindex[i])
+                continue;
+            otag = mtag_number(mf, oldindex[i] - 1);
+            for (slot = mtag_hash(otag->tagdata, otag->tagtype) & mask;
+                 mf->tagindex[slot]; slot = (slot + 1) & mask)
+                ;
+            mf->tagindex[slot] = oldindex[i];
+        }
+        free(oldindex);
+    }
+
+    mask = mf->tagindex_size - 1;
+    for (slot = mtag_hash(tag->tagdata, tag->tagtype) & mask;
+         mf->tagindex[slot]; slot = (slot + 1) & mask) {
+        struct memfile_tag *otag = mtag_number(mf, mf->tagindex[slot] - 1);
+
+        if (otag->tagtype == tag->tagtype && otag->tagdata == tag->tagdata)
+            break;
+    }
+    mf->tagindex[slot] = n + 1;
+}
+
 void
 mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
 {
-    /* 619 is chosen here because it's a prime number, and it's approximately
-       in the golden ratio with MEMFILE_HASHTABLE_SIZE. */
-    int bucket = (tagdata * 619 + (int)tagtype) % MEMFILE_HASHTABLE_SIZE;
-    struct memfile_tag *tag = malloc(sizeof (struct memfile_tag));
+    struct memfile_tag *tag;
+
+    if (mf->ntags % MEMFILE_TAGCHUNK_SIZE == 0) {
+        int nchunks = mf->ntags / MEMFILE_TAGCHUNK_SIZE;
 
-    tag->next = mf->tags[bucket];
+        mf->tagchunks = realloc(mf->tagchunks,
+                                (nchunks + 1) * sizeof *mf->tagchunks);
+        mf->tagchunks[nchunks] = malloc(MEMFILE_TAGCHUNK_SIZE *
+                                        sizeof (struct memfile_tag));
+    }
+
+    tag = mtag_number(mf, mf->ntags);
     tag->tagdata = tagdata;
     tag->tagtype = tagtype;
     tag->pos = mf->pos;
-    mf->tags[bucket] = tag;
+    tag->prev_tag = mf->last_tag;
     mf->last_tag = tag;
+    mtag_index(mf, mf->ntags++);
 
     if (mf->relativeto) {
-        for (tag = mf->relativeto->tags[bucket]; tag; tag = tag->next) {
-            if (tag->tagtype == tagtype && tag->tagdata == tagdata)
-                break;
-        }
+        tag = mtag_find(mf->relativeto, tagdata, tagtype);
         if (tag && mf->relativepos != tag->pos) {
             int offset = mf->relativepos - tag->pos;
 
@@ -1217,6 +1395,64 @@ mtag(struct memfile *mf, long tagdata, enum memfile_tagtype tagtype)
     }
 }
 
+/* Snapshotting memfiles. msnapshot records everything written to mf since
+   position startpos, along with every tag created since starttag (which should
+   be the value of mf->last_tag at the time mf->pos was startpos). mreplay then
+   writes the recorded data and tags onto the end of another memfile; for a diff
+   memfile, this produces the same diff as rewriting it by hand would (except
+   that monster coordinate hints aren't recorded, which can only affect how
+   compactly edits are encoded, not what they decode to). */
+void
+msnapshot(struct memfile_snapshot *snap, const struct memfile *mf,
+          int startpos, const struct memfile_tag *starttag)
+{
+    const struct memfile_tag *tag;
+    int i;
+
+    snap->len = mf->pos - startpos;
+    snap->buf = malloc(snap->len ? snap->len : 1);
+    memcpy(snap->buf, mf->buf + startpos, snap->len);
+
+    snap->ntags = 0;
+    for (tag = mf->last_tag; tag != starttag; tag = tag->prev_tag)
+        snap->ntags++;
+    snap->tags = malloc((snap->ntags ? snap->ntags : 1) *
+                        sizeof (struct memfile_snapshot_tag));
+
+    /* The tags are linked newest-first, but need to be replayed oldest-first,
+       so fill the array in from the end. */
+    i = snap->ntags;
+    for (tag = mf->last_tag; tag != starttag; tag = tag->prev_tag) {
+        i--;
+        snap->tags[i].tagdata = tag->tagdata;
+        snap->tags[i].tagtype = tag->tagtype;
+        snap->tags[i].pos = tag->pos - startpos;
+    }
+}
+
+void
+mreplay(struct memfile *mf, const struct memfile_snapshot *snap)
+{
+    int i, done = 0;
+
+    for (i = 0; i < snap->ntags; i++) {
+        mwrite(mf, snap->buf + done, snap->tags[i].pos - done);
+        done = snap->tags[i].pos;
+        mtag(mf, snap->tags[i].tagdata, snap->tags[i].tagtype);
+    }
+    mwrite(mf, snap->buf + done, snap->len - done);
+}
+
+void
+mfreesnapshot(struct memfile_snapshot *snap)
+{
+    free(snap->buf);
+    snap->buf = NULL;
+    free(snap->tags);
+    snap->tags = NULL;
+    snap->len = snap->ntags = 0;
+}
+
 void
 mread(struct memfile *mf, void *buf, unsigned int len)
 {
@@ -1335,11 +1571,12 @@ mequal(struct memfile *mf1, struct memfile *mf2, const char **difference_reason)
         for (off = 0; off < len; off++) {
             if (p1[off] != p2[off]) {
                 struct memfile_tag *tag = NULL, *titer;
-                for (bin = 0; bin < MEMFILE_HASHTABLE_SIZE; bin++)
-                    for (titer = mf2->tags[bin]; titer; titer = titer->next)
-                        if (titer->pos <= off)
-                            if (!tag || tag->pos < titer->pos)
-                                tag = titer;
+                for (bin = 0; bin < mf2->ntags; bin++) {
+                    titer = mtag_number(mf2, bin);
+                    if (titer->pos <= off)
+                        if (!tag || tag->pos < titer->pos)
+                            tag = titer;
+                }
 
                 if (!tag) {
 
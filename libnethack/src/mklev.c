@@ -1166,6 +1166,7 @@ mklev(d_level * levnum)
         if (obj->otyp == MAGIC_CHEST)
             lev->locations[obj->ox][obj->oy].flags |= W_NONDIGGABLE;
 
+    mark_terrain_changed(lev);
     return lev;
 }
 
@@ -1756,6 +1757,7 @@ mkinvokearea(void)
         pline(msgc_levelsound,
               "You are standing at the top of a stairwell leading down!");
     mkstairs(level, u.ux, u.uy, 0, NULL);       /* down */
+    mark_terrain_changed(level);
     newsym(u.ux, u.uy);
     turnstate.vision_full_recalc = TRUE;     /* everything changed */
 }
@@ -1146,6 +1146,7 @@ movebubbles(void)
 
                     level->locations[x][y] = water_pos;
                 }
+        mark_terrain_changed(level);
     }
 
     /* 
@@ -1468,6 +1469,7 @@ mv_bubble(struct level *lev, struct bubble *b, int dx, int dy, boolean ini)
                 lev->locations[x][y].typ = AIR;
                 lev->locations[x][y].lit = 1;
             }
+    mark_terrain_changed(lev);
 
     /* replace contents of bubble */
     for (cons = b->cons; cons; cons = ctemp) {
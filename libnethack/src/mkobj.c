@@ -14,6 +14,7 @@ static struct obj *mksobj_basic(struct level *lev, int otyp);
 static void obj_timer_checks(struct obj *, xchar, xchar, int);
 static void container_weight(struct obj *);
 static void save_mtraits(struct obj *, struct monst *);
+static void update_object_tile(struct level *, int, int);
 
 struct icp {
     int iprob;  /* probability of an item type */
@@ -429,6 +430,7 @@ splitobj(struct obj *obj, long num)
     obj->nobj = otmp;
     otmp->where = obj->where;
     otmp->o_id = next_ident();
+    index_obj(otmp);
     otmp->timed = 0;    /* not timed, yet */
     otmp->lamplit = 0;  /* ditto */
     otmp->owornmask = 0L;       /* new object isn't worn */
@@ -504,6 +506,9 @@ replace_object(struct obj *obj, struct obj *otmp)
         extract_nobj(obj, &obj->olev->objlist,
                      &turnstate.floating_objects, OBJ_FREE);
         extract_nexthere(obj, &obj->olev->objects[obj->ox][obj->oy]);
+        update_object_tile(obj->olev, obj->ox, obj->oy);
+        if (obj->otyp == BOULDER || otmp->otyp == BOULDER)
+            mark_terrain_changed(obj->olev);
         break;
     case OBJ_MIGRATING:
         otmp->nobj = obj->nobj;
@@ -540,6 +545,7 @@ bill_dummy_object(struct obj *otmp)
         subfrombill(otmp, shop_keeper(level, *u.ushops));
     dummy = newobj(otmp);
     dummy->o_id = next_ident();
+    index_obj(dummy);
     dummy->timed = 0;
     dummy->mem_obj = NULL;
     ox_copy(dummy, otmp);
@@ -615,6 +621,7 @@ mksobj(struct level *lev, int otyp, boolean init, boolean artif, enum rng rng)
 
     otmp = mksobj_basic(lev, otyp);
     otmp->o_id = next_ident();
+    index_obj(otmp);
 
     if (init) {
         switch (let) {
@@ -1387,7 +1394,10 @@ place_object(struct obj *otmp, struct level *lev, int x, int y)
         panic("placing object typ %d at bad position %d,%d",
               otmp->otyp, x, y);
 
+    mark_level_dirty(lev);
     obj_no_longer_held(otmp);
+    if (otmp->otyp == BOULDER)
+        mark_terrain_changed(lev);
     if (otmp->otyp == BOULDER && lev == level)
         block_point(x, y);      /* vision */
 
@@ -1398,6 +1408,7 @@ place_object(struct obj *otmp, struct level *lev, int x, int y)
     } else {
         otmp->nexthere = otmp2;
         lev->objects[x][y] = otmp;
+        update_object_tile(lev, x, y);
     }
 
     /* set the new object's location */
@@ -1519,6 +1530,47 @@ obj_timer_checks(struct obj *otmp, xchar x, xchar y, int force)
 #undef ON_ICE
 #undef ROT_ICE_ADJUSTMENT
 
+/* Keeps lev->object_tiles in step with lev->objects; call whenever the pile at
+   (x, y) might have become empty or non-empty. */
+static void
+update_object_tile(struct level *lev, int x, int y)
+{
+    uint64_t bit = (uint64_t)1 << ((x % 8) * 8 + y % 8);
+
+    if (lev->objects[x][y])
+        lev->object_tiles[x / 8][y / 8] |= bit;
+    else
+        lev->object_tiles[x / 8][y / 8] &= ~bit;
+}
+
+/* Returns how many objects are on the floor of lev within distmin() range of
+   (x, y). */
+int
+floor_objects_in_range(struct level *lev, int x, int y, int range)
+{
+    int lx = max(x - range, 0), hx = min(x + range, COLNO - 1);
+    int ly = max(y - range, 0), hy = min(y + range, ROWNO - 1);
+    int tx, ty, n = 0;
+    struct obj *otmp;
+
+    for (tx = lx / 8; tx <= hx / 8; tx++)
+        for (ty = ly / 8; ty <= hy / 8; ty++) {
+            uint64_t bits = lev->object_tiles[tx][ty];
+
+            while (bits) {
+                int bit = __builtin_ctzll(bits);
+                int ox = tx * 8 + bit / 8, oy = ty * 8 + bit % 8;
+
+                bits &= bits - 1;
+                if (ox < lx || ox > hx || oy < ly || oy > hy)
+                    continue;
+                for (otmp = lev->objects[ox][oy]; otmp; otmp = otmp->nexthere)
+                    n++;
+            }
+        }
+    return n;
+}
+
 void
 remove_object(struct obj *otmp)
 {
@@ -1527,9 +1579,13 @@ remove_object(struct obj *otmp)
 
     if (otmp->where != OBJ_FLOOR)
         panic("remove_object: obj not on floor");
+    mark_level_dirty(otmp->olev);
     extract_nexthere(otmp, &otmp->olev->objects[x][y]);
+    update_object_tile(otmp->olev, x, y);
     extract_nobj(otmp, &otmp->olev->objlist,
                  &turnstate.floating_objects, OBJ_FREE);
+    if (otmp->otyp == BOULDER)
+        mark_terrain_changed(otmp->olev);
     if (otmp->otyp == BOULDER && otmp->olev == level &&
         !sobj_at(BOULDER, level, x, y)) /* vision */
         unblock_point(x, y);
@@ -1597,14 +1653,17 @@ obj_extract_self(struct obj *obj)
         freeinv(obj);
         break;
     case OBJ_MINVENT:
+        mark_level_dirty(obj->ocarry->dlevel);
         extract_nobj(obj, &obj->ocarry->minvent,
                      &turnstate.floating_objects, OBJ_FREE);
         break;
     case OBJ_BURIED:
+        mark_level_dirty(obj->olev);
         extract_nobj(obj, &obj->olev->buriedobjlist,
                      &turnstate.floating_objects, OBJ_FREE);
         break;
     case OBJ_ONBILL:
+        mark_level_dirty(obj->olev);
         extract_nobj(obj, &obj->olev->billobjs,
                      &turnstate.floating_objects, OBJ_FREE);
         break;
@@ -1687,6 +1746,7 @@ add_to_minv(struct monst *mon, struct obj *obj, struct obj **new_obj)
 
     if (new_obj)
         *new_obj = obj;
+    mark_level_dirty(mon->dlevel);
     /* merge if possible */
     for (otmp = mon->minvent; otmp; otmp = otmp->nobj)
         if (merged(&otmp, &obj)) {
@@ -1734,6 +1794,7 @@ add_to_buried(struct obj *obj)
     if (obj->where != OBJ_FREE)
         panic("add_to_buried: obj not free");
 
+    mark_level_dirty(obj->olev);
     extract_nobj(obj, &turnstate.floating_objects,
                  &obj->olev->buriedobjlist, OBJ_BURIED);
 }
@@ -1797,6 +1858,7 @@ dealloc_obj(struct obj *obj)
         thrownobj = NULL;
 
     extract_nobj(obj, &turnstate.floating_objects, NULL, 0);
+    unindex_obj(obj);
 
     ox_free(obj);
     free(obj);
@@ -897,8 +897,8 @@ mcalcdistress(void)
 
 static struct monst *nmtmp = (struct monst *)0;
 
-int
-movemon(void)
+static int
+movemon_core(void)
 {
     struct monst *mtmp;
     boolean somebody_can_move = FALSE;
@@ -975,6 +975,16 @@ movemon(void)
     return somebody_can_move;
 }
 
+int
+movemon(void)
+{
+    unsigned long long start = profile_start();
+    int ret = movemon_core();
+
+    profile_stop(NHPROF_MOVEMON, start);
+    return ret;
+}
+
 
 #define mstoning(obj) (ofood(obj) && \
                        (touch_petrifies(&mons[(obj)->corpsenm]) || \
@@ -2360,6 +2370,7 @@ replmon(struct monst *mtmp, struct monst *mtmp2)
 
     mtmp2->nmon = mtmp2->dlevel->monlist;
     mtmp2->dlevel->monlist = mtmp2;
+    index_monst(mtmp2);
     if (u.ustuck == mtmp)
         u.ustuck = mtmp2;
     if (u.usteed == mtmp)
@@ -2393,8 +2404,9 @@ relmon(struct monst *mon)
 {
     struct monst *mtmp;
 
+    mark_level_dirty(mon->dlevel);
     mon->dlevel->dmonsters[mon->dx][mon->dy] = NULL;
-    mon->dlevel->monsters[mon->mx][mon->my] = NULL;
+    set_monster_at(mon->dlevel, mon->mx, mon->my, NULL);
 
     if (mon == mon->dlevel->monlist)
         mon->dlevel->monlist = mon->dlevel->monlist->nmon;
@@ -2407,6 +2419,7 @@ relmon(struct monst *mon)
         else
             panic("relmon: mon not in list.");
     }
+    unindex_monst(mon);
 }
 
 /* remove effects of mtmp from other data structures */
@@ -2425,7 +2438,7 @@ m_detach(struct monst *mtmp, const struct permonst *mptr)
     mtmp->mhp = 0;      /* simplify some tests: force mhp to 0 */
     relobj(mtmp, 0, FALSE);
     if (isok(mtmp->mx, mtmp->my)) {
-        mtmp->dlevel->monsters[mtmp->mx][mtmp->my] = NULL;
+        set_monster_at(mtmp->dlevel, mtmp->mx, mtmp->my, NULL);
         mtmp->dlevel->dmonsters[mtmp->dx][mtmp->dy] = NULL;
     }
     if (emits_light(mptr))
@@ -3175,6 +3188,56 @@ mnexto(struct monst *mtmp)
     return;
 }
 
+/* All writes to lev->monsters go through here, so that lev->monster_tiles
+   stays in step with it. */
+void
+set_monster_at(struct level *lev, xchar x, xchar y, struct monst *mon)
+{
+    uint64_t bit;
+
+    if (!isok(x, y))
+        return;
+    lev->monsters[x][y] = mon;
+    bit = (uint64_t)1 << ((x % 8) * 8 + y % 8);
+    if (mon)
+        lev->monster_tiles[x / 8][y / 8] |= bit;
+    else
+        lev->monster_tiles[x / 8][y / 8] &= ~bit;
+}
+
+/* Stores in found[] (of size maxfound) the monsters on lev whose own square is
+   within distmin() range of (x, y), and returns how many there were. That's
+   every monster on the map there, dead or alive, but not worm tail segments
+   and not the steed (which isn't on the map). They come in no particular
+   order. */
+int
+monsters_in_range(struct level *lev, int x, int y, int range,
+                  struct monst **found, int maxfound)
+{
+    int lx = max(x - range, 0), hx = min(x + range, COLNO - 1);
+    int ly = max(y - range, 0), hy = min(y + range, ROWNO - 1);
+    int tx, ty, n = 0;
+
+    for (tx = lx / 8; tx <= hx / 8; tx++)
+        for (ty = ly / 8; ty <= hy / 8; ty++) {
+            uint64_t bits = lev->monster_tiles[tx][ty];
+
+            while (bits) {
+                int bit = __builtin_ctzll(bits);
+                int mx = tx * 8 + bit / 8, my = ty * 8 + bit % 8;
+                struct monst *mon = lev->monsters[mx][my];
+
+                bits &= bits - 1;
+                if (mx < lx || mx > hx || my < ly || my > hy ||
+                    mon->mx != mx || mon->my != my)
+                    continue;
+                if (n < maxfound)
+                    found[n++] = mon;
+            }
+        }
+    return n;
+}
+
 void
 remove_monster(struct level *lev, xchar x, xchar y)
 {
@@ -3182,8 +3245,9 @@ remove_monster(struct level *lev, xchar x, xchar y)
     if (!mon)
         return;
 
+    mark_level_dirty(lev);
     /* remove the map->monster reference */
-    lev->monsters[x][y] = NULL;
+    set_monster_at(lev, x, y, NULL);
 
     /* remove displaced image */
     if (displaced(mon))
@@ -3206,6 +3270,7 @@ place_monster(struct monst *mon, xchar x, xchar y, boolean updatedisplacement)
 
     boolean you = (mon == &youmonst);
     if (!you) {
+        mark_level_dirty(mon->dlevel);
         mon->mx = x;
         mon->my = y;
     } else {
@@ -3215,7 +3280,7 @@ place_monster(struct monst *mon, xchar x, xchar y, boolean updatedisplacement)
 
     if (isok(x, y)) {
         if (!you) /* Too much in the game relies on the player not existing as a m_at... */
-            mon->dlevel->monsters[x][y] = mon;
+            set_monster_at(mon->dlevel, x, y, mon);
     } else
         impossible("placing monster on invalid spot (%d,%d)", x, y);
 
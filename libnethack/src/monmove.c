@@ -1267,6 +1267,7 @@ not_special:
             if (door->flags == D_CLOSED && can_open) {
                 if (btrapped) {
                     door->flags = D_NODOOR;
+                    mark_terrain_changed(level);
                     newsym(nix, niy);
                     unblock_point(nix, niy);      /* vision */
                     if (mb_trapped(mtmp))
@@ -1281,6 +1282,7 @@ not_special:
                                      "a door open.");
                     }
                     door->flags = D_ISOPEN;
+                    mark_terrain_changed(level);
                     newsym(nix, niy);
                     unblock_point(nix, niy);
                 }
@@ -1357,6 +1359,7 @@ postmov:
                 } else if (here->flags & D_LOCKED && can_unlock) {
                     if (btrapped) {
                         here->flags = D_NODOOR;
+                        mark_terrain_changed(level);
                         newsym(mtmp->mx, mtmp->my);
                         unblock_point(mtmp->mx, mtmp->my);      /* vision */
                         if (mb_trapped(mtmp))
@@ -1369,12 +1372,14 @@ postmov:
                             You_hear(msgc_levelsound,
                                      "a door unlock and open.");
                         here->flags = D_ISOPEN;
+                        mark_terrain_changed(level);
                         /* newsym(mtmp->mx, mtmp->my); */
                         unblock_point(mtmp->mx, mtmp->my);      /* vision */
                     }
                 } else if (here->flags == D_CLOSED && can_open) {
                     if (btrapped) {
                         here->flags = D_NODOOR;
+                        mark_terrain_changed(level);
                         newsym(mtmp->mx, mtmp->my);
                         unblock_point(mtmp->mx, mtmp->my);      /* vision */
                         if (mb_trapped(mtmp))
@@ -1385,6 +1390,7 @@ postmov:
                         else
                             You_hear(msgc_levelsound, "a door open.");
                         here->flags = D_ISOPEN;
+                        mark_terrain_changed(level);
                         /* newsym(mtmp->mx, mtmp->my); *//* done below */
                         unblock_point(mtmp->mx, mtmp->my);      /* vision */
                     }
@@ -1392,6 +1398,7 @@ postmov:
                     /* mfndpos guarantees this must be a doorbuster */
                     if (btrapped) {
                         here->flags = D_NODOOR;
+                        mark_terrain_changed(level);
                         newsym(mtmp->mx, mtmp->my);
                         unblock_point(mtmp->mx, mtmp->my);      /* vision */
                         if (mb_trapped(mtmp))
@@ -1406,6 +1413,7 @@ postmov:
                             here->flags = D_NODOOR;
                         else
                             here->flags = D_BROKEN;
+                        mark_terrain_changed(level);
                         /* newsym(mtmp->mx, mtmp->my); *//* done below */
                         unblock_point(mtmp->mx, mtmp->my);  /* vision */
                     }
@@ -1058,28 +1058,39 @@ find_unlocker(struct monst *mon, struct musable *m)
     return FALSE;
 }
 
-/* Returns closest target hostile to mon up to range_limit */
+/* Returns closest target hostile to mon up to range_limit. mm_aggression()
+   can use the RNG, so it's called for every monster, in monlist order; the
+   sensing checks only happen for monsters that could still be the closest. */
 struct monst *
 find_closest_target(struct monst *mon, int range_limit)
 {
     int hostrange = 0;
+    int dist;
     struct monst *mtmp;
     struct monst *mclose = NULL;
 
+    begin_sensing_scope();
     for (mtmp = monlist(mon->dlevel); mtmp; mtmp = monnext(mtmp)) {
         if (DEADMONSTER(mtmp) || mon == mtmp ||
-            !mm_aggression(mon, mtmp, FALSE) ||
-            !msensem(mon, mtmp))
+            !mm_aggression(mon, mtmp, FALSE))
+            continue;
+        /* Skip the sensing checks if they can't change the result: a monster
+           that's no closer than mclose can't replace it, and one that's out of
+           range can only be replaced or rejected later (except that anything
+           replaces an mclose at distance 0). */
+        dist = distmin(mon->mx, mon->my, mtmp->mx, mtmp->my);
+        if ((hostrange && hostrange <= dist) ||
+            (dist > range_limit && (!mclose || hostrange)))
+            continue;
+        if (!msensem(mon, mtmp))
             continue;
         if ((msensem(mon, mtmp) & MSENSE_ANYVISION) ||
             m_cansee(mon, mtmp->mx, mtmp->my)) {
-            if (!hostrange ||
-                hostrange > distmin(mon->mx, mon->my, mtmp->mx, mtmp->my)) {
-                hostrange = distmin(mon->mx, mon->my, mtmp->mx, mtmp->my);
-                mclose = mtmp;
-            }
+            hostrange = dist;
+            mclose = mtmp;
         }
     }
+    end_sensing_scope();
 
     if (mclose && hostrange > range_limit)
         mclose = NULL; /* no close targets */
@@ -2254,6 +2265,7 @@ use_item(struct musable *m)
         else
             You_hear(msgc_levelwarning, "a door unlock.");
         door->flags = btrapped ? D_NODOOR : D_CLOSED;
+        mark_terrain_changed(level);
         newsym(x, y);
         unblock_point(x, y); /* vision */
         if (btrapped && mb_trapped(mon))
@@ -2296,6 +2308,7 @@ use_item(struct musable *m)
                   t->ttyp == TRAPDOOR ? "trap door" : "hole");
             if (level->locations[trapx][trapy].typ == SCORR) {
                 level->locations[trapx][trapy].typ = CORR;
+                mark_terrain_changed(level);
                 unblock_point(trapx, trapy);
             }
             seetrap(t_at(level, trapx, trapy));
@@ -2367,6 +2380,7 @@ use_item(struct musable *m)
                   makeplural(locomotion(mon->data, "jump")));
             if (level->locations[trapx][trapy].typ == SCORR) {
                 level->locations[trapx][trapy].typ = CORR;
+                mark_terrain_changed(level);
                 unblock_point(trapx, trapy);
             }
             seetrap(t_at(level, trapx, trapy));
@@ -377,6 +377,7 @@ do_earthquake(int force)
                     if (*in_rooms(level, x, y, SHOPBASE))
                         add_damage(x, y, 0L);
                     level->locations[x][y].flags = D_NODOOR;
+                    mark_terrain_changed(level);
                     unblock_point(x, y);
                     newsym(x, y);
                     break;
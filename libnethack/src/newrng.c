@@ -12,7 +12,8 @@
    to /dev/null/nethack), which was in turn based on that in the public domain
    LibTomCrypt. The entropy collectors are also based on AdeonRNG, and as far as
    I know, originated there. For NetHack 4, the code was reformatted and
-   simplified via removing unused codepaths. */
+   simplified via removing unused codepaths, and later specialized to hash
+   several RNG seeds at once. */
 
 #ifdef AIMAKE_BUILDOS_MSWin32
 # define WIN32_LEAN_AND_MEAN /* else windows.h tries to define "boolean" */
@@ -27,12 +28,6 @@
 #include "rm.h"
 #include <sys/time.h>
 
-struct sha256_state {
-    uint64_t length;
-    uint32_t state[8], curlen;
-    unsigned char buf[64];
-};
-
 /* the K array */
 static const uint32_t K[64] = {
     0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
@@ -50,20 +45,11 @@ static const uint32_t K[64] = {
     0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
 };
 
-static void
-sha256_init(struct sha256_state *ss)
-{
-    ss->curlen = 0;
-    ss->length = 0;
-    ss->state[0] = 0x6A09E667UL;
-    ss->state[1] = 0xBB67AE85UL;
-    ss->state[2] = 0x3C6EF372UL;
-    ss->state[3] = 0xA54FF53AUL;
-    ss->state[4] = 0x510E527FUL;
-    ss->state[5] = 0x9B05688CUL;
-    ss->state[6] = 0x1F83D9ABUL;
-    ss->state[7] = 0x5BE0CD19UL;
-}
+/* the initial hash value */
+static const uint32_t H0[8] = {
+    0x6A09E667UL, 0xBB67AE85UL, 0x3C6EF372UL, 0xA54FF53AUL, 0x510E527FUL,
+    0x9B05688CUL, 0x1F83D9ABUL, 0x5BE0CD19UL
+};
 
 /* Note: these assume uint32_t arguments. */
 #define S(x, n)      (((x) >> (n)) | ((x) << (32 - (n))))
@@ -75,133 +61,73 @@ sha256_init(struct sha256_state *ss)
 #define Gamma0(x)    (S(x, 7) ^ S(x, 18) ^ R(x, 3))
 #define Gamma1(x)    (S(x, 17) ^ S(x, 19) ^ R(x, 10))
 
+/* All our messages are RNG seeds, and thus fit into a single block; so we can
+   pad them and calculate their hashes directly, several at a time. The loops
+   over lanes are written so that a compiler can vectorize them. */
+#define SHA256_LANES 8
+static_assert(RNG_SEED_SIZE_BYTES <= 55, "RNG seeds must fit in one block");
+
 static void
-sha256_compress(struct sha256_state *ss, const unsigned char buf[64])
+sha256_seeds(const unsigned char seeds[static SHA256_LANES]
+             [RNG_SEED_SIZE_BYTES], uint32_t out[static SHA256_LANES][8])
 {
-    uint32_t S[8], W[64];
-    int i;
-
-    /* copy state into S */
-    for (i = 0; i < 8; i++) {
-        S[i] = ss->state[i];
-    }
-
-    /* copy the state into 512-bits into W[0..15] */
-    const unsigned char *bp = buf;
-    for (i = 0; i < 16; i++) {
-        W[i]  = *bp++ << 24;
-        W[i] |= *bp++ << 16;
-        W[i] |= *bp++ <<  8;
-        W[i] |= *bp++ <<  0;
+    uint32_t W[64][SHA256_LANES];
+    uint32_t a[SHA256_LANES], b[SHA256_LANES], c[SHA256_LANES],
+        d[SHA256_LANES], e[SHA256_LANES], f[SHA256_LANES], g[SHA256_LANES],
+        h[SHA256_LANES];
+    unsigned char buf[64];
+    int i, l;
+
+    /* pad each message, and copy it into W[0..15] */
+    for (l = 0; l < SHA256_LANES; l++) {
+        memset(buf, 0, sizeof buf);
+        memcpy(buf, seeds[l], RNG_SEED_SIZE_BYTES);
+        buf[RNG_SEED_SIZE_BYTES] = (unsigned char)0x80;
+        buf[62] = ((RNG_SEED_SIZE_BYTES * 8) >> 8) & 255;
+        buf[63] = ((RNG_SEED_SIZE_BYTES * 8) >> 0) & 255;
+
+        const unsigned char *bp = buf;
+        for (i = 0; i < 16; i++) {
+            W[i][l]  = (uint32_t)*bp++ << 24;
+            W[i][l] |= (uint32_t)*bp++ << 16;
+            W[i][l] |= (uint32_t)*bp++ <<  8;
+            W[i][l] |= (uint32_t)*bp++ <<  0;
+        }
     }
 
     /* fill W[16..63] */
-    for (i = 16; i < 64; i++) {
-        W[i] = Gamma1(W[i - 2]) + W[i - 7] + Gamma0(W[i - 15]) + W[i - 16];
+    for (i = 16; i < 64; i++)
+        for (l = 0; l < SHA256_LANES; l++)
+            W[i][l] = Gamma1(W[i - 2][l]) + W[i - 7][l] +
+                Gamma0(W[i - 15][l]) + W[i - 16][l];
+
+    for (l = 0; l < SHA256_LANES; l++) {
+        a[l] = H0[0]; b[l] = H0[1];
+        c[l] = H0[2]; d[l] = H0[3];
+        e[l] = H0[4]; f[l] = H0[5];
+        g[l] = H0[6]; h[l] = H0[7];
     }
 
     /* Compress */
-    for (i = 0; i < 64; ++i) {
-        uint32_t t, t0, t1;
+    for (i = 0; i < 64; i++) {
+        for (l = 0; l < SHA256_LANES; l++) {
+            uint32_t t0, t1;
 
-        t0 = S[7] + Sigma1(S[4]) + Ch(S[4], S[5], S[6]) + K[i] + W[i];
-        t1 = Sigma0(S[0]) + Maj(S[0], S[1], S[2]);
-        S[3] += t0;
-        S[7] = t0 + t1;
+            t0 = h[l] + Sigma1(e[l]) + Ch(e[l], f[l], g[l]) + K[i] + W[i][l];
+            t1 = Sigma0(a[l]) + Maj(a[l], b[l], c[l]);
 
-        t = S[7]; S[7] = S[6]; S[6] = S[5]; S[5] = S[4];
-        S[4] = S[3]; S[3] = S[2]; S[2] = S[1]; S[1] = S[0]; S[0] = t;
-    }
-
-    /* feedback */
-    for (i = 0; i < 8; i++) {
-        ss->state[i] += S[i];
-    }
-}
-
-static const int sha256_block_size = 64;
-static void
-sha256_process(struct sha256_state *ss,
-               const unsigned char *in, unsigned long inlen)
-{
-    unsigned long n;
-
-    if (ss->curlen > sizeof(ss->buf))
-        panic("corrupted sha256 state in sha256_process");
-
-    while (inlen > 0) {
-
-        if (ss->curlen == 0 && inlen >= sha256_block_size) {
-
-            sha256_compress(ss, in);
-
-            ss->length += sha256_block_size * 8;
-            in += sha256_block_size;
-            inlen -= sha256_block_size;
-
-        } else {
-
-            n = sha256_block_size - ss->curlen;
-            if (n > inlen)
-                n = inlen;
-
-            memcpy(ss->buf + ss->curlen, in, (size_t)n);
-            ss->curlen += n;
-            in += n;
-            inlen -= n;
-
-            if (ss->curlen == sha256_block_size) {
-
-                sha256_compress(ss, ss->buf);
-                ss->length += sha256_block_size * 8;
-                ss->curlen = 0;
-            }
+            h[l] = g[l]; g[l] = f[l]; f[l] = e[l]; e[l] = d[l] + t0;
+            d[l] = c[l]; c[l] = b[l]; b[l] = a[l]; a[l] = t0 + t1;
         }
     }
-}
-
-/* Note: the output lifetime of the return pointer (which points to eight 32-bit
-   numbers) is equal to that of the input struct sha256_state. */
-static uint32_t *
-sha256_done(struct sha256_state *ss)
-{
-    if (ss->curlen >= sizeof(ss->buf))
-        panic("corrupted sha256 state in sha256-done");
-
-    /* increase the length of the message */
-    ss->length += ss->curlen * 8;
-
-    /* append the '1' bit */
-    ss->buf[ss->curlen++] = (unsigned char)0x80;
 
-    /* if the length is currently above 56 bytes we append zeros then compress.
-       Then we can fall back to padding zeros and length encoding like
-       normal. */
-    if (ss->curlen > 56) {
-        while (ss->curlen < 64) {
-            ss->buf[ss->curlen++] = (unsigned char)0;
-        }
-        sha256_compress(ss, ss->buf);
-        ss->curlen = 0;
-    }
-
-    /* pad up to 56 bytes of zeroes */
-    while (ss->curlen < 56) {
-        ss->buf[ss->curlen++] = (unsigned char)0;
+    /* feedback */
+    for (l = 0; l < SHA256_LANES; l++) {
+        out[l][0] = H0[0] + a[l]; out[l][1] = H0[1] + b[l];
+        out[l][2] = H0[2] + c[l]; out[l][3] = H0[3] + d[l];
+        out[l][4] = H0[4] + e[l]; out[l][5] = H0[5] + f[l];
+        out[l][6] = H0[6] + g[l]; out[l][7] = H0[7] + h[l];
     }
-
-    /* store length */
-    ss->buf[56] = (ss->length >> 56) & 255;
-    ss->buf[57] = (ss->length >> 48) & 255;
-    ss->buf[58] = (ss->length >> 40) & 255;
-    ss->buf[59] = (ss->length >> 32) & 255;
-    ss->buf[60] = (ss->length >> 24) & 255;
-    ss->buf[61] = (ss->length >> 16) & 255;
-    ss->buf[62] = (ss->length >>  8) & 255;
-    ss->buf[63] = (ss->length >>  0) & 255;
-    sha256_compress(ss, ss->buf);
-
-    return ss->state;
 }
 
 /* End of SHA-256 code. Start of entropy collectors (based on AdeonRNG by Mikko
@@ -429,29 +355,70 @@ get_initial_rng_seed(char out[static RNG_SEED_SIZE_BASE64])
 
 /* Generation. */
 
+/* Increase a seed. We treat it as one big little-endian number. */
+static void
+increment_seed(unsigned char seedarray[static RNG_SEED_SIZE_BYTES])
+{
+    int s;
+    for (s = 0; s < RNG_SEED_SIZE_BYTES; s++) {
+        seedarray[s]++;
+        if (seedarray[s])
+            break;
+    }
+}
+
+/* Lookahead. A seed only ever moves forwards, so we can calculate the hashes
+   of the next several seeds of an RNG in one go, and hand them out one at a
+   time. The cache remembers the seed it expects to see next, and isn't used
+   unless the seed matches; so anything else that writes to the seed (restoring
+   a save, reseeding, reverting a zero-time command) simply causes the hashes
+   to be recalculated, rather than needing to tell us about it. */
+struct rng_lookahead {
+    unsigned char seed[RNG_SEED_SIZE_BYTES]; /* seed that the next hash is for */
+    int left;                                /* number of hashes not used yet */
+    uint32_t hashes[SHA256_LANES][8];
+};
+
+/* indexed by RNG number + 1, so that rng_display has an entry */
+static struct rng_lookahead rng_lookahead[last_rng + 1];
+
+static const uint32_t *
+hash_from_lookahead(struct rng_lookahead *la,
+                    const unsigned char seedarray[static RNG_SEED_SIZE_BYTES])
+{
+    if (!la->left || memcmp(la->seed, seedarray, RNG_SEED_SIZE_BYTES) != 0) {
+
+        unsigned char seeds[SHA256_LANES][RNG_SEED_SIZE_BYTES];
+        int l;
+
+        memcpy(seeds[0], seedarray, RNG_SEED_SIZE_BYTES);
+        for (l = 1; l < SHA256_LANES; l++) {
+            memcpy(seeds[l], seeds[l - 1], RNG_SEED_SIZE_BYTES);
+            increment_seed(seeds[l]);
+        }
+
+        sha256_seeds(seeds, la->hashes);
+        memcpy(la->seed, seedarray, RNG_SEED_SIZE_BYTES);
+        la->left = SHA256_LANES;
+    }
+
+    increment_seed(la->seed);
+    return la->hashes[SHA256_LANES - la->left--];
+}
+
 static uint32_t
 rn2_from_seedarray(uint32_t maxplus1,
-                   unsigned char seedarray[static RNG_SEED_SIZE_BYTES])
+                   unsigned char seedarray[static RNG_SEED_SIZE_BYTES],
+                   struct rng_lookahead *la)
 {
-    struct sha256_state ss;
-
     if (maxplus1 == 0) {
         impossible("Impossible range 0 <= x < 0 for a random number");
         maxplus1 = 1;
     }
 
-    /* Calculate the SHA-256 of the current seed. */
-    sha256_init(&ss);
-    sha256_process(&ss, seedarray, RNG_SEED_SIZE_BYTES);
-    uint32_t *out = sha256_done(&ss);
-
-    /* Increase the seed. We treat it as one big little-endian number. */
-    int s;
-    for (s = 0; s < RNG_SEED_SIZE_BYTES; s++) {
-        seedarray[s]++;
-        if (seedarray[s])
-            break;
-    }
+    /* Get the SHA-256 of the current seed, then increase the seed. */
+    const uint32_t *out = hash_from_lookahead(la, seedarray);
+    increment_seed(seedarray);
 
     /* Produce output in the range 0..maxplus1-1. We look through the 32-bit
        numbers that the SHA-256 algorithm calculated, trying each one in turn to
@@ -475,12 +442,13 @@ rn2_from_seedarray(uint32_t maxplus1,
        game will tend to correspond to high return values in other games. */
     uint64_t unbiased_maximum =
         ((uint64_t)0x100000000LLU / maxplus1) * maxplus1;
+    int s;
     for (s = 0; s < 8; s++) {
         if (out[s] < unbiased_maximum)
             return out[s] / (unbiased_maximum / maxplus1);
     }
 
-    return rn2_from_seedarray(maxplus1, seedarray);
+    return rn2_from_seedarray(maxplus1, seedarray, la);
 }
 
 int
@@ -502,7 +470,8 @@ rn2_on_rng(int maxplus1, enum rng rng)
            for the sequence to be particularly secure, so we can start at 0. */
         static unsigned char display_rng_seed[RNG_SEED_SIZE_BYTES] = {0};
 
-        return (int)rn2_from_seedarray(maxplus1, display_rng_seed);
+        return (int)rn2_from_seedarray(maxplus1, display_rng_seed,
+                                       rng_lookahead + 0);
 
     } else if (rng == rng_initialseed) {
 
@@ -515,7 +484,8 @@ rn2_on_rng(int maxplus1, enum rng rng)
             impossible("Zero-time command used main RNG");
 
         return (int)rn2_from_seedarray(maxplus1,
-            flags.rngstate + rng * RNG_SEED_SIZE_BYTES);
+            flags.rngstate + rng * RNG_SEED_SIZE_BYTES,
+            rng_lookahead + rng + 1);
 
     } else {
 
@@ -2851,6 +2851,7 @@ srch:
         p = bp + strlen(bp);
         if (!BSTRCMP(bp, p - 8, "fountain")) {
             level->locations[u.ux][u.uy].typ = FOUNTAIN;
+            mark_terrain_changed(level);
             if (!strncmpi(bp, "magic ", 6))
                 level->locations[u.ux][u.uy].blessedftn = 1;
             pline(msgc_info, "A %sfountain.",
@@ -2860,18 +2861,21 @@ srch:
         }
         if (!BSTRCMP(bp, p - 6, "throne")) {
             level->locations[u.ux][u.uy].typ = THRONE;
+            mark_terrain_changed(level);
             pline(msgc_info, "A throne.");
             newsym(u.ux, u.uy);
             return &zeroobj;
         }
         if (!BSTRCMP(bp, p - 4, "sink")) {
             level->locations[u.ux][u.uy].typ = SINK;
+            mark_terrain_changed(level);
             pline(msgc_info, "A sink.");
             newsym(u.ux, u.uy);
             return &zeroobj;
         }
         if (!BSTRCMP(bp, p - 4, "pool")) {
             level->locations[u.ux][u.uy].typ = POOL;
+            mark_terrain_changed(level);
             del_engr_at(level, u.ux, u.uy);
             pline(msgc_info, "A pool.");
             /* Must manually make kelp! */
@@ -2881,6 +2885,7 @@ srch:
         }
         if (!BSTRCMP(bp, p - 4, "lava")) {      /* also matches "molten lava" */
             level->locations[u.ux][u.uy].typ = LAVAPOOL;
+            mark_terrain_changed(level);
             del_engr_at(level, u.ux, u.uy);
             pline(msgc_info, "A pool of molten lava.");
             if (!aboveliquid(&youmonst))
@@ -2893,6 +2898,7 @@ srch:
             aligntyp al;
 
             level->locations[u.ux][u.uy].typ = ALTAR;
+            mark_terrain_changed(level);
             if (!strncmpi(bp, "chaotic ", 8))
                 al = A_CHAOTIC;
             else if (!strncmpi(bp, "neutral ", 8))
@@ -2918,6 +2924,7 @@ srch:
 
         if (!BSTRCMP(bp, p - 4, "tree")) {
             level->locations[u.ux][u.uy].typ = TREE;
+            mark_terrain_changed(level);
             pline(msgc_info, "A tree.");
             newsym(u.ux, u.uy);
             block_point(u.ux, u.uy);
@@ -2926,6 +2933,7 @@ srch:
 
         if (!BSTRCMP(bp, p - 4, "bars")) {
             level->locations[u.ux][u.uy].typ = IRONBARS;
+            mark_terrain_changed(level);
             pline(msgc_info, "Iron bars.");
             newsym(u.ux, u.uy);
             return &zeroobj;
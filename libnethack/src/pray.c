@@ -1341,6 +1341,7 @@ dosacrifice(const struct nh_cmd_arg *arg)
                           "vanishes in %s cloud!", an(hcolor("black")));
                     level->locations[u.ux][u.uy].typ = ROOM;
                     level->locations[u.ux][u.uy].flags = 0;
+                    mark_terrain_changed(level);
                     newsym(u.ux, u.uy);
                     angry_priest();
                     demonless_msg = "cloud dissipates";
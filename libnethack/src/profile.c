@@ -0,0 +1,68 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* NetHack may be freely redistributed.  See license for details. */
+
+#include "hack.h"
+#include <time.h>
+
+/* Timing of a few expensive engine paths, so that the benchmarks in the
+   testbench can see where the time in a command goes.
+
+   Profiling is off unless a client turns it on, in which case profile_start()
+   doesn't read the clock and profile_stop() is a single test. The times are
+   wall-clock and include any nested sections (movemon() usually includes some
+   vision_recalc() time, for instance); a section that's left via an exception,
+   such as the hero dying inside movemon(), isn't counted at all. None of this
+   touches the game state, so it can't cause a save desync. */
+
+static boolean profiling = FALSE;
+static struct nh_profile profile;
+
+static unsigned long long
+profile_clock(void)
+{
+#ifdef UNIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL +
+        (unsigned long long)ts.tv_nsec;
+#else
+    return (unsigned long long)utc_time() * 1000ULL;
+#endif
+}
+
+/* Returns the value to pass to profile_stop() at the end of the section, or 0
+   if profiling is off. */
+unsigned long long
+profile_start(void)
+{
+    return profiling ? profile_clock() : 0;
+}
+
+void
+profile_stop(enum nh_profile_section section, unsigned long long start)
+{
+    /* A zero start means profiling was turned on during the section. */
+    if (!profiling || !start)
+        return;
+
+    profile.calls[section]++;
+    profile.nanoseconds[section] += profile_clock() - start;
+}
+
+void
+nh_set_profiling(boolean enabled)
+{
+    profiling = enabled;
+}
+
+/* Copies the totals since the last reset into *out, and optionally resets
+   them. */
+void
+nh_get_profile(struct nh_profile *out, boolean reset)
+{
+    *out = profile;
+    if (reset)
+        memset(&profile, 0, sizeof profile);
+}
+
+/*profile.c*/
@@ -2580,11 +2580,106 @@ msensem_xy(struct monst *viewer, struct monst *viewee,
     return sensed;
 }
 
+/* Memoization for msensem(). Its result depends on far too much game state
+   (vision, lighting, and a dozen properties of each monster, most of which are
+   changed by direct assignment all over the code) for it to be practical to
+   notice every change. Instead, the memo is only consulted inside a "sensing
+   scope", which callers open around code that asks the same questions
+   repeatedly without changing anything in between, such as drawing the map or
+   a monster surveying its targets. Opening an outermost scope starts a new
+   generation, which invalidates everything remembered earlier.
+
+   Positions are part of the key even so, because msensem_xy() moves the
+   viewer about temporarily. */
+#define MSENSEM_MEMO_SIZE 64 /* must be a power of 2 */
+
+struct msensem_memo {
+    const struct monst *viewer, *viewee;
+    const struct level *lev;
+    unsigned generation;
+    xchar sx, sy, tx, ty, dx, dy;
+    unsigned sensemethod;
+};
+
+static struct msensem_memo msensem_memo[MSENSEM_MEMO_SIZE];
+static unsigned msensem_generation = 1;
+static int sensing_scope_depth = 0;
+
+void
+begin_sensing_scope(void)
+{
+    if (sensing_scope_depth++)
+        return;
+
+    /* Generation 0 marks an unused memo entry. */
+    if (!++msensem_generation) {
+        memset(msensem_memo, 0, sizeof msensem_memo);
+        msensem_generation = 1;
+    }
+}
+
+void
+end_sensing_scope(void)
+{
+    if (sensing_scope_depth <= 0)
+        impossible("Ending a sensing scope that was never begun");
+    else
+        sensing_scope_depth--;
+}
+
+/* Forgets any scopes that are still open, together with everything remembered
+   in them. A scope is left open if the code inside it is abandoned via a
+   longjmp (e.g. a panic, or leaving the game), so this is called before each
+   command, and when the game's data is freed. */
+void
+reset_sensing_scope(void)
+{
+    sensing_scope_depth = 0;
+    memset(msensem_memo, 0, sizeof msensem_memo);
+    msensem_generation = 1;
+}
+
+static unsigned msensem_core(const struct monst *, const struct monst *);
+
 /* Returns the bitwise OR of all MSENSE_ values that explain how "viewer" can
    see "viewee". &youmonst is accepted as either argument. If both arguments
    are the same, this tests if/how a monster/player can detect itself. */
 unsigned
 msensem(const struct monst *viewer, const struct monst *viewee)
+{
+    struct msensem_memo *memo;
+    uintptr_t hash;
+
+    if (!sensing_scope_depth)
+        return msensem_core(viewer, viewee);
+
+    hash = ((uintptr_t)viewer >> 4) * 31 + ((uintptr_t)viewee >> 4);
+    memo = &msensem_memo[(hash ^ (hash >> 6)) & (MSENSEM_MEMO_SIZE - 1)];
+
+    if (memo->generation == msensem_generation &&
+        memo->viewer == viewer && memo->viewee == viewee &&
+        memo->lev == level &&
+        memo->sx == m_mx(viewer) && memo->sy == m_my(viewer) &&
+        memo->tx == m_mx(viewee) && memo->ty == m_my(viewee) &&
+        memo->dx == viewee->dx && memo->dy == viewee->dy)
+        return memo->sensemethod;
+
+    memo->sensemethod = msensem_core(viewer, viewee);
+    memo->generation = msensem_generation;
+    memo->viewer = viewer;
+    memo->viewee = viewee;
+    memo->lev = level;
+    memo->sx = m_mx(viewer);
+    memo->sy = m_my(viewer);
+    memo->tx = m_mx(viewee);
+    memo->ty = m_my(viewee);
+    memo->dx = viewee->dx;
+    memo->dy = viewee->dy;
+    return memo->sensemethod;
+}
+
+static unsigned
+msensem_core(const struct monst *viewer, const struct monst *viewee)
 {
     unsigned sensemethod = 0;
 
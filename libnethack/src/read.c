@@ -1642,6 +1642,7 @@ seffects(struct monst *mon, struct obj *sobj, boolean *known)
                 for (y = 0; y < ROWNO; y++)
                     if (level->locations[x][y].typ == SDOOR)
                         cvt_sdoor_to_door(&level->locations[x][y], &u.uz);
+            mark_terrain_changed(level);
             /* do_mapping() already reveals secret passages */
         }
         *known = TRUE;
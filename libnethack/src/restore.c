@@ -6,7 +6,6 @@
 #include "hack.h"
 #include "artifact.h"
 #include "lev.h"
-#include "trietable.h"
 #include <stdint.h>
 
 static void restore_autopickup_rules(struct memfile *mf,
@@ -18,8 +17,7 @@ static void restore_memobj(struct memfile *mf);
 static void restlevchn(struct memfile *mf);
 static void restdamage(struct memfile *mf, struct level *lev, boolean ghostly);
 static void restobjchn(struct memfile *mf, struct level *lev,
-                       boolean ghostly, boolean frozen, struct obj **chain,
-                       struct trietable **table);
+                       boolean ghostly, boolean frozen, struct obj **chain);
 static struct monst *restmonchn(struct memfile *mf, struct level *lev,
                                 boolean ghostly);
 static struct fruit *loadfruitchn(struct memfile *mf, boolean
@@ -67,6 +65,7 @@ find_lev_obj(struct level *lev)
     for (x = 0; x < COLNO; x++)
         for (y = 0; y < ROWNO; y++)
             lev->objects[x][y] = NULL;
+    memset(lev->object_tiles, 0, sizeof lev->object_tiles);
 
     /*
      * Reverse the entire lev->objlist chain, which is necessary so that we can
@@ -122,14 +121,13 @@ restore_memobj(struct memfile *mf)
     int i;
     for (i = 0; i <= maxledgerno(); i++) {
         if (levels[i]) {
-            restobjchn(mf, levels[i], FALSE, FALSE, &(levels[i]->memobjlist),
-                       NULL);
+            restobjchn(mf, levels[i], FALSE, FALSE, &(levels[i]->memobjlist));
 
             find_lev_memobj(levels[i]);
         }
     }
 
-    restobjchn(mf, level, FALSE, FALSE, &(youmonst.meminvent), NULL);
+    restobjchn(mf, level, FALSE, FALSE, &(youmonst.meminvent));
 }
 
 static void
@@ -242,7 +240,7 @@ restdamage(struct memfile *mf, struct level *lev, boolean ghostly)
 
 static void
 restobjchn(struct memfile *mf, struct level *lev, boolean ghostly,
-           boolean frozen, struct obj **chainloc, struct trietable **table)
+           boolean frozen, struct obj **chainloc)
 {
     struct obj *otmp;
     unsigned int count;
@@ -278,9 +276,8 @@ restobjchn(struct memfile *mf, struct level *lev, boolean ghostly,
         if (ghostly && !frozen && !age_is_relative(otmp))
             otmp->age = moves - lev->lastmoves + otmp->age;
 
-        /* we might need to produce an index, for speed in relinking IDs */
-        if (table)
-            trietable_add(table, otmp->o_id, otmp);
+        /* index it only now that any bones renumbering is done */
+        index_obj(otmp);
 
         /* If this is an object memory, relink it. */
         if (otmp->mem_o_id && otmp->memory != OM_NO_MEMORY) {
@@ -307,7 +304,7 @@ restobjchn(struct memfile *mf, struct level *lev, boolean ghostly,
         if (Has_contents(otmp)) {
             struct obj *otmp3;
 
-            restobjchn(mf, lev, ghostly, Is_IceBox(otmp), &otmp->cobj, table);
+            restobjchn(mf, lev, ghostly, Is_IceBox(otmp), &otmp->cobj);
             /* restore container back pointers */
             for (otmp3 = otmp->cobj; otmp3; otmp3 = otmp3->nobj)
                 otmp3->ocontainer = otmp;
@@ -366,9 +363,12 @@ restmonchn(struct memfile *mf, struct level *lev, boolean ghostly)
                 mtmp->mhpmax = DEFUNCT_MONSTER;
             }
         }
+        /* a chain restored without a level is migrating_mons */
+        if (lev)
+            index_monst(mtmp);
 
         if (mtmp->minvent) {
-            restobjchn(mf, lev, ghostly, FALSE, &(mtmp->minvent), NULL);
+            restobjchn(mf, lev, ghostly, FALSE, &(mtmp->minvent));
             /* restore monster back pointer */
             for (obj = mtmp->minvent; obj; obj = obj->nobj)
                 obj->ocarry = mtmp;
@@ -596,7 +596,7 @@ restgamestate(struct memfile *mf)
     restore_timers(mf, lev, RANGE_GLOBAL, FALSE, 0L);
     restore_light_sources(mf, lev);
     if (flags.save_revision < 7)
-        restobjchn(mf, lev, FALSE, FALSE, &youmonst.minvent, NULL);
+        restobjchn(mf, lev, FALSE, FALSE, &youmonst.minvent);
     migrating_mons = restmonchn(mf, NULL, FALSE);
     restore_mvitals(mf);
 
@@ -631,7 +631,7 @@ restgamestate(struct memfile *mf)
     restore_history(mf);
 
     if (flags.save_revision >= 19) {
-        restobjchn(mf, NULL, FALSE, FALSE, &gamestate.chest, NULL);
+        restobjchn(mf, NULL, FALSE, FALSE, &gamestate.chest);
         if (gamestate.chest && gamestate.chest->ocontainer)
             gamestate.chest->ocontainer->cobj = gamestate.chest;
     }
@@ -641,7 +641,7 @@ restgamestate(struct memfile *mf)
         restore_memobj(mf);
 
     /* must come after all mons & objs are restored */
-    relink_timers(FALSE, lev, NULL);
+    relink_timers(FALSE, lev);
     relink_light_sources(FALSE, lev);
 
     if (u.ustuck) {
@@ -1060,8 +1060,8 @@ restore_flags(struct memfile *mf, struct flag *f)
 }
 
 
-int
-dorecover(struct memfile *mf)
+static int
+dorecover_core(struct memfile *mf)
 {
     int count;
     xchar ltmp;
@@ -1092,8 +1092,7 @@ dorecover(struct memfile *mf)
 
     mon = restore_mon(mf, NULL, NULL);
     if (mon->minvent)
-        restobjchn(mf, NULL, FALSE, FALSE,
-                   &(mon->minvent), NULL);
+        restobjchn(mf, NULL, FALSE, FALSE, &(mon->minvent));
 
     if (flags.save_revision < 12)
         mx_eyou_new(mon);
@@ -1172,6 +1171,16 @@ dorecover(struct memfile *mf)
     return 1;
 }
 
+int
+dorecover(struct memfile *mf)
+{
+    unsigned long long start = profile_start();
+    int ret = dorecover_core(mf);
+
+    profile_stop(NHPROF_DORECOVER, start);
+    return ret;
+}
+
 static void
 finalize_recover(void)
 {
@@ -1410,7 +1419,6 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
     int x, y;
     unsigned int lflags;
     struct level *lev;
-    struct trietable *table = NULL;
 
     if (ghostly)
         clear_id_mapping();
@@ -1520,18 +1528,18 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
     if (flags.save_revision < 17)
         check_sokoban_completion(lev, TRUE);
 
-    restobjchn(mf, lev, ghostly, FALSE, &lev->objlist, &table);
+    restobjchn(mf, lev, ghostly, FALSE, &lev->objlist);
     find_lev_obj(lev);
     /* restobjchn()'s `frozen' argument probably ought to be a callback routine
        so that we can check for objects being buried under ice */
-    restobjchn(mf, lev, ghostly, FALSE, &lev->buriedobjlist, &table);
-    restobjchn(mf, lev, ghostly, FALSE, &lev->billobjs, &table);
+    restobjchn(mf, lev, ghostly, FALSE, &lev->buriedobjlist);
+    restobjchn(mf, lev, ghostly, FALSE, &lev->billobjs);
     rest_engravings(mf, lev);
 
     /* reset level->monsters for new level */
     for (x = 0; x < COLNO; x++)
         for (y = 0; y < ROWNO; y++)
-            lev->monsters[x][y] = NULL;
+            set_monster_at(lev, x, y, NULL);
     for (mtmp = lev->monlist; mtmp; mtmp = mtmp->nmon) {
         if (mx_eshk(mtmp))
             set_residency(mtmp, FALSE);
@@ -1613,15 +1621,14 @@ getlev(struct memfile *mf, xchar levnum, boolean ghostly)
     }
 
     /* must come after all mons & objs are restored */
-    relink_timers(ghostly, lev, &table);
+    relink_timers(ghostly, lev);
     relink_light_sources(ghostly, lev);
     reset_oattached_mids(ghostly, lev);
 
     if (ghostly)
         clear_id_mapping();
 
-    trietable_empty(&table);
-
+    mark_terrain_changed(lev);
     return lev;
 }
 
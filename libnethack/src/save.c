@@ -16,6 +16,7 @@
 static void save_you(struct memfile *mf, struct you *you);
 static void save_utracked(struct memfile *mf, struct you *you);
 static void savelevchn(struct memfile *mf);
+static void savelev_cached(struct memfile *mf, xchar levnum);
 static void savedamage(struct memfile *mf, struct level *lev);
 static void freedamage(struct level *lev);
 static void save_memobj(struct memfile *mf);
@@ -88,8 +89,8 @@ GEN_SAVE_DECODE(32, 0xFFFFFFFF)
 
 /* The save code itself. */
 
-void
-savegame(struct memfile *mf)
+static void
+savegame_core(struct memfile *mf)
 {
     int count = 0;
     xchar ltmp;
@@ -124,7 +125,7 @@ savegame(struct memfile *mf)
             continue;
         mtag(mf, ltmp, MTAG_LEVELS);
         mwrite8(mf, ltmp);      /* level number */
-        savelev(mf, ltmp);      /* actual level */
+        savelev_cached(mf, ltmp);       /* actual level */
     }
     savegamestate(mf);
 
@@ -134,6 +135,15 @@ savegame(struct memfile *mf)
     update_whereis(FALSE);
 }
 
+void
+savegame(struct memfile *mf)
+{
+    unsigned long long start = profile_start();
+
+    savegame_core(mf);
+    profile_stop(NHPROF_SAVEGAME, start);
+}
+
 
 /* WARNING: Do not use save encoding functions in this function; although they
    will work on save, the restore code couldn't handle them */
@@ -722,11 +732,98 @@ savelev(struct memfile *mf, xchar levnum)
 }
 
 
+/*
+ * Level save caching.
+ *
+ * savegame() runs after almost every command, but levels other than the one
+ * the hero is on hardly ever change from one turn to the next. So for each
+ * such level we keep a snapshot of its save data, and write that into the save
+ * file unchanged for as long as the level stays the same.
+ *
+ * The current level is never cached. Any code that changes a level other than
+ * the current level must call mark_level_dirty() on it; in wizard mode, each
+ * use of the cache is checked against a fresh savelev() to catch missing
+ * calls.
+ */
+
+/* Save encodings other than saveenc_levelrel make the save data of a level
+   depend on the turn counter, not just the level itself. */
+static long
+level_save_cache_key(void)
+{
+    if (flags.save_encoding == saveenc_levelrel)
+        return -1;
+    return moves;
+}
+
+void
+mark_level_dirty(struct level *lev)
+{
+    if (lev && lev->save_cache) {
+        mfreesnapshot(lev->save_cache);
+        free(lev->save_cache);
+        lev->save_cache = NULL;
+    }
+}
+
+static boolean
+level_save_cache_ok(xchar levnum)
+{
+    struct level *lev = levels[levnum];
+    struct memfile checkmf;
+    boolean ok;
+
+    if (!flags.debug)
+        return TRUE;
+
+    mnew(&checkmf, NULL);
+    savelev(&checkmf, levnum);
+    ok = checkmf.pos == lev->save_cache->len &&
+        !memcmp(checkmf.buf, lev->save_cache->buf, checkmf.pos);
+    mfree(&checkmf);
+
+    if (!ok)
+        impossible("Level %d changed without being marked dirty",
+                   (int)levnum);
+    return ok;
+}
+
+static void
+savelev_cached(struct memfile *mf, xchar levnum)
+{
+    struct level *lev = levels[levnum];
+    struct memfile_tag *starttag = mf->last_tag;
+    int startpos = mf->pos;
+
+    if (lev == level || lev->flags.purge_monsters) {
+        mark_level_dirty(lev);
+        savelev(mf, levnum);
+        return;
+    }
+
+    if (lev->save_cache && lev->save_cache_key == level_save_cache_key()) {
+        if (level_save_cache_ok(levnum)) {
+            mreplay(mf, lev->save_cache);
+            return;
+        }
+    }
+
+    mark_level_dirty(lev);
+    savelev(mf, levnum);
+
+    lev->save_cache = malloc(sizeof (struct memfile_snapshot));
+    msnapshot(lev->save_cache, mf, startpos, starttag);
+    lev->save_cache_key = level_save_cache_key();
+}
+
+
 void
 freelev(xchar levnum)
 {
     struct level *lev = levels[levnum];
 
+    mark_level_dirty(lev);
+
     /* must be freed before mons, objs, and buried objs */
     free_timers(lev);
     free_light_sources(lev);
@@ -1012,6 +1109,7 @@ freedynamicdata(void)
             continue;
 
         /* level-specific data */
+        mark_level_dirty(lev);
         dmonsfree(lev); /* release dead monsters */
         free_timers(lev);
         free_light_sources(lev);
@@ -1045,6 +1143,7 @@ freedynamicdata(void)
     free_waterlevel();
     free_dungeon();
     free_history();
+    clear_id_indexes();
 
     if (flags.last_str_buf) {
         free(flags.last_str_buf);
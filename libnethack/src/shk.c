@@ -157,6 +157,7 @@ shkgone(struct monst *mtmp)
     char *p;
     int sx, sy;
 
+    mark_level_dirty(shoplev);
     remove_damage(mtmp, TRUE);
     sroom->resident = NULL;
 
@@ -1728,20 +1729,61 @@ bp_to_obj(struct bill_x *bp)
 }
 
 
+/*
+ * Works out where an object from the ID index is, for find_oid() and
+ * find_oid_lev().  Returns FALSE if it isn't on any of the chains they
+ * search: the hero's inventory, the magic chest, and each level's floor,
+ * buried objects, and monsters' inventories (including those of migrating
+ * monsters), together with the contents of anything on those chains.
+ * Otherwise, sets *lev to the level the chain belongs to, or NULL if it
+ * doesn't belong to a level.
+ */
+static boolean
+find_oid_where(struct obj *obj, struct level **lev)
+{
+    struct monst *mon;
+
+    *lev = NULL;
+    while (obj->where == OBJ_CONTAINED) {
+        if (!obj->ocontainer)
+            return TRUE;        /* in the magic chest, while it's closed */
+        obj = obj->ocontainer;
+    }
+
+    switch (obj->where) {
+    case OBJ_INVENT:
+        return TRUE;
+    case OBJ_FLOOR:
+    case OBJ_BURIED:
+        *lev = obj->olev;
+        return TRUE;
+    case OBJ_MINVENT:
+        mon = obj->ocarry;
+        if (indexed_monst(mon->m_id) == mon) {
+            *lev = mon->dlevel;
+            return TRUE;
+        }
+        for (mon = migrating_mons; mon; mon = mon->nmon)
+            if (mon == obj->ocarry)
+                return TRUE;
+        for (mon = turnstate.migrating_pets; mon; mon = mon->nmon)
+            if (mon == obj->ocarry)
+                return TRUE;
+        return FALSE;
+    default:
+        /* free, on a bill, or migrating */
+        return FALSE;
+    }
+}
+
 struct obj *
 find_oid_lev(struct level *lev, unsigned id)
 {
-    struct obj *obj;
-    struct monst *mon;
+    struct obj *obj = indexed_obj(id);
+    struct level *olev;
 
-    if ((obj = o_on(id, lev->objlist)) != 0)
+    if (obj && find_oid_where(obj, &olev) && olev && olev == lev)
         return obj;
-    if ((obj = o_on(id, lev->buriedobjlist)) != 0)
-        return obj;
-
-    for (mon = lev->monlist; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)) != 0)
-            return obj;
 
     return NULL;
 }
@@ -1754,37 +1796,17 @@ find_oid_lev(struct level *lev, unsigned id)
 struct obj *
 find_oid(unsigned id)
 {
-    struct obj *obj;
-    struct monst *mon;
-    int i;
-
-    /* first check various obj lists directly */
-    if ((obj = o_on(id, youmonst.minvent)))
-        return obj;
-
-    /* try searching the current level, if any */
-    if (level && (obj = find_oid_lev(level, id)))
-        return obj;
-
-    /* not found yet; check inventory for members of various monst lists */
-    for (mon = migrating_mons; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)))
-            return obj;
-    for (mon = turnstate.migrating_pets; mon; mon = mon->nmon)
-        if ((obj = o_on(id, mon->minvent)))
-            return obj;
+    struct obj *obj = indexed_obj(id);
+    struct level *olev;
 
-    /* search magic chest */
-    if ((obj = o_on(id, gamestate.chest)))
-        return obj;
+    if (!obj || !find_oid_where(obj, &olev))
+        return NULL;
 
-    /* search all levels */
-    for (i = 0; i <= maxledgerno(); i++)
-        if (levels[i] && (obj = find_oid_lev(levels[i], id)))
-            return obj;
+    /* the caller might change it */
+    if (olev && olev != level)
+        mark_level_dirty(olev);
 
-    /* not found at all */
-    return NULL;
+    return obj;
 }
 
 
@@ -2394,6 +2416,7 @@ sub_one_frombill(struct obj *obj, struct monst *shkp)
         if (bp->bquan > obj->quan) {
             otmp = newobj(obj);
             bp->bo_id = otmp->o_id = next_ident();
+            index_obj(otmp);
             otmp->quan = (bp->bquan -= obj->quan);
             otmp->owt = 0;      /* superfluous */
             ox_free(otmp);
@@ -3028,6 +3051,7 @@ remove_damage(struct monst *shkp, boolean croaked)
     uchar saw_walls = 0;
     struct level *lev = levels[ledger_no(&mx_eshk(shkp)->shoplevel)];
 
+    mark_level_dirty(lev);
     tmp_dam = lev->damagelist;
     tmp2_dam = 0;
     while (tmp_dam) {
@@ -3153,6 +3177,7 @@ repair_damage(struct level *lev, struct monst *shkp, struct damage *tmp_dam,
             lev->locations[x][y].typ = tmp_dam->typ;
             block_point(x, y);
         }
+        mark_terrain_changed(lev);
         if (lev == level)
             newsym(x, y);
         return floordamage ? 2 : 3;
@@ -3166,6 +3191,7 @@ repair_damage(struct level *lev, struct monst *shkp, struct damage *tmp_dam,
         /* No messages if player already replaced shop door */
         return 1;
     lev->locations[x][y].typ = tmp_dam->typ;
+    mark_terrain_changed(lev);
     memset(litter, 0, sizeof (litter));
     if ((otmp = lev->objects[x][y]) != 0) {
         /* Scatter objects haphazardly into the shop */
@@ -3214,6 +3240,7 @@ repair_damage(struct level *lev, struct monst *shkp, struct damage *tmp_dam,
     block_point(x, y);
     if (IS_DOOR(tmp_dam->typ)) {
         lev->locations[x][y].flags = D_CLOSED;       /* arbitrary */
+        mark_terrain_changed(lev);
         if (lev == level)
             newsym(x, y);
     } else {
@@ -309,6 +309,7 @@ dosit(const struct nh_cmd_arg *arg)
             IS_THRONE(level->locations[u.ux][u.uy].typ)) {
             /* may have teleported */
             level->locations[u.ux][u.uy].typ = ROOM;
+            mark_terrain_changed(level);
             pline(msgc_consequence,
                   "The throne vanishes in a puff of logic.");
             newsym(u.ux, u.uy);
@@ -5,7 +5,6 @@
 
 #include "hack.h"
 #include "lev.h"        /* for checking save modes */
-#include "trietable.h"
 #include <stdint.h>
 
 static void see_lamp_flicker(struct obj *, const char *);
@@ -989,6 +988,7 @@ start_timer(struct level *lev, long when, short kind, short func_index,
     gnu->needs_fixup = FALSE;
     gnu->func_index = func_index;
     gnu->arg = arg;
+    mark_level_dirty(lev);
     insert_timer(lev, gnu);
 
     if (kind == TIMER_OBJECT)   /* increment object's timed count */
@@ -1009,6 +1009,7 @@ stop_timer(struct level *lev, short func_index, void *arg)
     timer_element *doomed;
     long timeout;
 
+    mark_level_dirty(lev);
     doomed = remove_timer(&lev->lev_timers, func_index, arg);
 
     if (doomed) {
@@ -1335,6 +1336,8 @@ transfer_timers(struct level *oldlev, struct level *newlev,
             else
                 oldlev->lev_timers = curr->next;
 
+            mark_level_dirty(oldlev);
+            mark_level_dirty(newlev);
             insert_timer(newlev, curr);
             /* prev stays the same */
         } else {
@@ -1442,7 +1445,7 @@ restore_timers(struct memfile *mf, struct level *lev, int range,
 
 /* reset all timers that are marked for resetting */
 void
-relink_timers(boolean ghostly, struct level *lev, struct trietable **table)
+relink_timers(boolean ghostly, struct level *lev)
 {
     timer_element *curr;
     unsigned nid;
@@ -1456,25 +1459,14 @@ relink_timers(boolean ghostly, struct level *lev, struct trietable **table)
                 } else
                     nid = (intptr_t) curr->arg;
 
-                /* If necessary, we'll find the object in question using
-                   find_oid. However, if we happened to cache its location in
-                   a trietable, we can use that instead and save some time.
-
-                   The semantics here are that the trietable is allowed to be
-                   missing the object in question altogether; but if the
-                   object's ID is a key in the table, the value will be the
-                   object itself.
-
-                   (This optimization is necessary; I've seen games with over
-                   7000 timers, and without the optimization, they each had
-                   to loop over all the objects on the level to find the one
-                   they were applying to. That was quadratic performance, and
-                   not irrelevantly so either.) */
-                curr->arg = NULL;
-                if (table)
-                    curr->arg = trietable_find(table, nid);
-                if (!curr->arg)
-                    curr->arg = find_oid(nid);
+                /* Every restored object is in the ID index by now, so look
+                   it up there directly rather than via find_oid(), which
+                   would also check where it is and mark its level dirty.
+
+                   (This matters; I've seen games with over 7000 timers, and
+                   searching the level's objects for each of them was
+                   quadratic, and not irrelevantly so either.) */
+                curr->arg = indexed_obj(nid);
                 if (!curr->arg)
                     panic("cant find o_id %d", nid);
                 curr->needs_fixup = 0;
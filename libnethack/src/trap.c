@@ -294,6 +294,7 @@ maketrap(struct level *lev, int x, int y, int typ, enum rng rng)
     struct rm *loc;
     boolean oldplace;
 
+    mark_level_dirty(lev);
     if ((ttmp = t_at(lev, x, y)) != 0) {
         if (ttmp->ttyp == MAGIC_PORTAL)
             return NULL;
@@ -371,6 +372,7 @@ maketrap(struct level *lev, int x, int y, int typ, enum rng rng)
             loc->typ =
                 lev->flags.is_maze_lev ? ROOM : lev->
                 flags.is_cavernous_lev ? CORR : DOOR;
+        mark_terrain_changed(lev);
 
         unearth_objs(lev, x, y);
         break;
@@ -1421,8 +1423,10 @@ blow_up_landmine(struct trap *trap)
     scatter(x, y, 4, MAY_DESTROY | MAY_HIT | MAY_FRACTURE | VIS_EFFECTS, NULL);
     del_engr_at(level, trap->tx, trap->ty);
     wake_nearto(trap->tx, trap->ty, 400);
-    if (IS_DOOR(level->locations[trap->tx][trap->ty].typ))
+    if (IS_DOOR(level->locations[trap->tx][trap->ty].typ)) {
         level->locations[trap->tx][trap->ty].flags = D_BROKEN;
+        mark_terrain_changed(level);
+    }
     if (!IS_DRAWBRIDGE(level->locations[trap->tx][trap->ty].typ)) {
         trap->ttyp = PIT;       /* explosion creates a pit */
         trap->madeby_u = FALSE; /* resulting pit isn't yours */
@@ -1657,6 +1661,7 @@ launch_obj(short otyp, int x1, int y1, int x2, int y2, int style)
                 pline(msgc_consequence,
                       "The boulder crashes through a door.");
             level->locations[bhitpos.x][bhitpos.y].flags = D_BROKEN;
+            mark_terrain_changed(level);
             if (dist)
                 unblock_point(bhitpos.x, bhitpos.y);
         }
@@ -4094,6 +4099,7 @@ untrap(const struct nh_cmd_arg *arg, boolean force)
                 pline(msgc_substitute, "You set it off!");
                 b_trapped("door", FINGER);
                 level->locations[x][y].flags = D_NODOOR;
+                mark_terrain_changed(level);
                 unblock_point(x, y);
                 newsym(x, y);
                 /* (probably ought to charge for this damage...) */
@@ -4410,6 +4416,7 @@ deltrap(struct level *lev, struct trap *trap)
 {
     struct trap *ttmp;
 
+    mark_level_dirty(lev);
     if (trap == lev->lev_traps)
         lev->lev_traps = lev->lev_traps->ntrap;
     else {
@@ -51,6 +51,7 @@ clear_fcorr(struct monst *grd, boolean forceshow)
         }
         oldtyp = level->locations[fcx][fcy].typ;
         level->locations[fcx][fcy].typ = mx_egd(grd)->fakecorr[fcbeg].ftyp;
+        mark_terrain_changed(level);
         if (!ACCESSIBLE(level->locations[fcx][fcy].typ) && ACCESSIBLE(oldtyp)) {
             struct trap *t = t_at(level, fcx, fcy);
 
@@ -398,6 +399,7 @@ invault(void)
         }
         level->locations[x][y].typ = DOOR;
         level->locations[x][y].flags = D_NODOOR;
+        mark_terrain_changed(level);
         unblock_point(x, y);    /* doesn't block light */
         mx_egd(guard)->fcend = 1;
         mx_egd(guard)->warncnt = 1;
@@ -460,6 +462,7 @@ wallify_vault(struct monst *grd)
                     typ = HWALL;
                 level->locations[x][y].typ = typ;
                 level->locations[x][y].flags = 0;
+                mark_terrain_changed(level);
                 /* 
                  * hack: player knows walls are restored because of the
                  * message, below, so show this on the screen.
@@ -547,6 +550,7 @@ gd_move(struct monst *grd)
                 verbalize(msgc_npcanger, "You've been warned, knave!");
                 mnexto(grd);
                 level->locations[m][n].typ = egrd->fakecorr[0].ftyp;
+                mark_terrain_changed(level);
                 newsym(m, n);
                 sethostility(grd, TRUE, FALSE);
                 return -1;
@@ -563,6 +567,7 @@ gd_move(struct monst *grd)
                 n = grd->my;
                 rloc(grd, FALSE);
                 level->locations[m][n].typ = egrd->fakecorr[0].ftyp;
+                mark_terrain_changed(level);
                 newsym(m, n);
                 sethostility(grd, TRUE, FALSE);
             letknow:
@@ -746,6 +751,7 @@ nextpos:
     }
     crm->typ = CORR;
 proceed:
+    mark_terrain_changed(level);
     unblock_point(nx, ny);      /* doesn't block light */
     if (cansee(nx, ny))
         newsym(nx, ny);
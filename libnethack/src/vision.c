@@ -90,6 +90,22 @@ static char *viz_clear_rows[ROWNO];
 static char left_ptrs[ROWNO][COLNO];    /* LOS algorithm helpers */
 static char right_ptrs[ROWNO][COLNO];
 
+/*
+ * Line-of-sight matrix: remembers the result of clear_path()'s line walk for
+ * each ordered pair of squares, as two bits per pair (whether the answer is
+ * known, and if so whether the path is clear).  It depends only on viz_clear,
+ * so it describes the current level; each change to viz_clear bumps
+ * los_generation, and a source square's row of the matrix is thrown away the
+ * next time it is used if it was filled in under an older generation.
+ */
+#define LOS_SQUARES (ROWNO * COLNO)
+#define LOS_WORDS ((LOS_SQUARES + 31) / 32)
+
+static uint32_t los_known[LOS_SQUARES][LOS_WORDS];
+static uint32_t los_clear[LOS_SQUARES][LOS_WORDS];
+static unsigned los_row_generation[LOS_SQUARES];
+static unsigned los_generation = 1;
+
 /* Forward declarations. */
 static void fill_point(int, int);
 static void dig_point(int, int);
@@ -97,6 +113,7 @@ static void view_from(int, int, char **, char *, char *, int,
                       void (*)(int, int, void *), void *);
 static void get_unused_cs(char ***, char **, char **);
 static void rogue_vision(char **, char *, char *);
+static void los_changed(void);
 
 /* Macro definitions that I can't find anywhere. */
 #define sign(z) ((z) < 0 ? -1 : ((z) ? 1 : 0 ))
@@ -190,6 +207,7 @@ vision_reset(void)
 
     /* Reset the pointers and clear so that we have a "full" dungeon. */
     memset(viz_clear, 0, sizeof (viz_clear));
+    los_changed();
 
     /* Dig the level */
     for (y = 0; y < ROWNO; y++) {
@@ -480,8 +498,8 @@ new_angle(struct rm *loc, unsigned char *sv, int row, int col)
  *     + Right after the hero is swallowed. [gulpmu()]
  *     + Just before bubbles are moved. [movebubbles()]
  */
-void
-vision_recalc(int control)
+static void
+vision_recalc_core(int control)
 {
     char **temp_array;  /* points to the old vision array */
     char **next_array;  /* points to the new vision array */
@@ -774,6 +792,15 @@ skip:
     viz_rmax = next_rmax;
 }
 
+void
+vision_recalc(int control)
+{
+    unsigned long long start = profile_start();
+
+    vision_recalc_core(control);
+    profile_stop(NHPROF_VISION_RECALC, start);
+}
+
 
 /*
  * block_point()
@@ -872,6 +899,7 @@ dig_point(int row, int col)
         return; /* already done */
 
     viz_clear[row][col] = 1;
+    los_changed();
 
     /* 
      * Boundary cases first.
@@ -957,6 +985,7 @@ fill_point(int row, int col)
         return;
 
     viz_clear[row][col] = 0;
+    los_changed();
 
     if (col == 0) {
         if (viz_clear[row][1]) {        /* adjacent is clear */
@@ -1279,6 +1308,29 @@ q3_path(int srow, int scol, int y2, int x2)
 }
 
 
+/*
+ * Invalidate the whole line-of-sight matrix, because viz_clear changed.
+ */
+static void
+los_changed(void)
+{
+    /* Generation 0 is never current, so that zeroed rows start out stale. */
+    if (!++los_generation) {
+        memset(los_row_generation, 0, sizeof los_row_generation);
+        los_generation = 1;
+    }
+}
+
+/*
+ * Returns a number that changes whenever clear_path() might give a different
+ * answer for squares other than the hero's; it's never 0.
+ */
+unsigned
+clear_path_generation(void)
+{
+    return los_generation;
+}
+
 /*
  * Use vision tables to determine if there is a clear path from
  * (col1,row1) to (col2,row2).  This is used by:
@@ -1300,7 +1352,8 @@ q3_path(int srow, int scol, int y2, int x2)
 boolean
 clear_path(int col1, int row1, int col2, int row2, char **couldsee_data)
 {
-    int result;
+    int result, src, dst;
+    uint32_t bit;
 
     if (!isok(col1, row1))
         return FALSE;
@@ -1314,6 +1367,15 @@ clear_path(int col1, int row1, int col2, int row2, char **couldsee_data)
     else if (col2 == u.ux && row2 == u.uy && couldsee_data)
         return !!(couldsee_data[row1][col1] & COULD_SEE);
 
+    src = row1 * COLNO + col1;
+    dst = row2 * COLNO + col2;
+    bit = (uint32_t)1 << (dst % 32);
+    if (los_row_generation[src] != los_generation) {
+        memset(los_known[src], 0, sizeof los_known[src]);
+        los_row_generation[src] = los_generation;
+    } else if (los_known[src][dst / 32] & bit)
+        return !!(los_clear[src][dst / 32] & bit);
+
     if (col1 < col2) {
         if (row1 > row2) {
             result = q1_path(row1, col1, row2, col2);
@@ -1329,6 +1391,12 @@ clear_path(int col1, int row1, int col2, int row2, char **couldsee_data)
             result = q3_path(row1, col1, row2, col2);
         }
     }
+
+    los_known[src][dst / 32] |= bit;
+    if (result)
+        los_clear[src][dst / 32] |= bit;
+    else
+        los_clear[src][dst / 32] &= ~bit;
     return (boolean) result;
 }
 
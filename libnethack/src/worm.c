@@ -141,7 +141,7 @@ toss_wsegs(struct level *lev, struct wseg *curr, boolean display_update)
 
         /* need to check curr->wx for genocided while migrating_mon */
         if (curr->wx) {
-            lev->monsters[curr->wx][curr->wy] = NULL;
+            set_monster_at(lev, curr->wx, curr->wy, NULL);
 
             /* update screen before deallocation */
             if (display_update && lev == level)
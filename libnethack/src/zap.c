@@ -3789,6 +3789,7 @@ melt_ice(struct level *lev, xchar x, xchar y)
         loc->typ = (loc->flags == ICED_POOL ? POOL : MOAT);
         loc->flags = 0;
     }
+    mark_terrain_changed(lev);
     obj_ice_effects(lev, x, y, FALSE);
     unearth_objs(lev, x, y);
 
@@ -3851,6 +3852,7 @@ zap_over_floor(xchar x, xchar y, int type, boolean * shopdamage)
 
                 rangemod -= 3;
                 loc->typ = ROOM;
+                mark_terrain_changed(level);
                 ttmp = maketrap(level, x, y, PIT, rng_main);
                 if (ttmp)
                     ttmp->tseen = 1;
@@ -3888,6 +3890,7 @@ zap_over_floor(xchar x, xchar y, int type, boolean * shopdamage)
                     loc->flags = (loc->typ == POOL ? ICED_POOL : ICED_MOAT);
                 loc->typ = (lava ? ROOM : ICE);
             }
+            mark_terrain_changed(level);
             bury_objs(level, x, y);
             if (cansee(x, y)) {
                 if (moat)
@@ -3982,6 +3985,7 @@ zap_over_floor(xchar x, xchar y, int type, boolean * shopdamage)
                     add_damage(x, y, 0L);
             }
             loc->flags = new_doormask;
+            mark_terrain_changed(level);
             unblock_point(x, y);        /* vision */
             if (cansee(x, y)) {
                 pline(msgc_consequence, "%s", see_txt);
@@ -4024,6 +4028,8 @@ fracture_rock(struct obj *obj)
     if (obj->otyp == BOULDER && Sokoban && !flags.mon_moving)
         change_luck(-1);
 
+    if (obj->otyp == BOULDER && obj->where == OBJ_FLOOR)
+        mark_terrain_changed(obj->olev);
     obj->otyp = ROCK;
     obj->quan = (long)rn1(60, 7);
     obj->owt = weight(obj);
@@ -25,6 +25,7 @@ extern jmp_buf ex_jmp_buf;
 extern int ex_jmp_buf_valid;
 extern int conn_err;
 extern int error_retry_ok;
+extern int binary_dbuf;
 extern char saved_password[];
 
 /* connection.c */
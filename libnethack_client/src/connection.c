@@ -23,6 +23,9 @@ static char *unread_message_endptr = unread_messages;
 static int net_active;
 int conn_err, error_retry_ok;
 
+/* Whether the server agreed to send map updates in binary form. */
+int binary_dbuf;
+
 /* Prevent automatic retries during connection setup or teardown. When the
    connection is being set up, it is better to report a failure immediately;
    when the connection is being closed it doesn't matter if it already is */
@@ -459,7 +462,8 @@ do_connect(const char *host, int port, const char *user, const char *pass,
 
     in_connect_disconnect = TRUE;
     sockfd = fd;
-    jmsg = json_pack("{ss,ss}", "username", user, "password", pass);
+    jmsg = json_pack("{ss,ss,sb}", "username", user, "password", pass,
+                     "binary_dbuf", 1);
     if (reg_user) {
         if (email)
             json_object_set_new(jmsg, "email", json_string(email));
@@ -486,6 +490,8 @@ do_connect(const char *host, int port, const char *user, const char *pass,
         nhnet_server_ver.patchlevel =
             json_integer_value(json_array_get(jarr, 2));
     }
+    /* as is "binary_dbuf"; servers that don't know about it send JSON */
+    binary_dbuf = json_is_true(json_object_get(jmsg, "binary_dbuf"));
     json_decref(jmsg);
 
     if (host != saved_hostname)
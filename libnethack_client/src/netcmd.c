@@ -283,6 +283,109 @@ cmd_print_message(json_t *params, int display_only)
 }
 
 static struct nh_dbuf_entry dbuf[ROWNO][COLNO];
+
+/* Map deltas in binary form; see "update_screen" in doc/server_protocol.txt
+   (and srv_update_screen_binary in the server, which produces them). */
+#define PACKED_DBUF_ENTRY_LEN 19
+#define MAX_BINARY_DBUF_LEN (ROWNO * COLNO * (PACKED_DBUF_ENTRY_LEN + 3) + 6)
+
+static int
+base64_decode_binary(const char *in, unsigned char *out, int outlen)
+{
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned long w = 0;
+    int bits = 0, len = 0;
+    const char *c;
+
+    for (; *in && *in != '='; in++) {
+        c = strchr(b64, *in);
+        if (!c)
+            return -1;
+        w = (w << 6) | (c - b64);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            if (len == outlen)
+                return -1;
+            out[len++] = (w >> bits) & 0xff;
+        }
+    }
+    return len;
+}
+
+static int
+get_varint(const unsigned char **p, const unsigned char *end, int *n)
+{
+    int shift = 0;
+
+    *n = 0;
+    while (*p < end && shift < 28) {
+        *n |= (**p & 0x7f) << shift;
+        if (!(*(*p)++ & 0x80))
+            return 1;
+        shift += 7;
+    }
+    return 0;
+}
+
+static int
+get_le(const unsigned char **p, int bytes)
+{
+    unsigned long n = 0;
+    int i;
+
+    for (i = 0; i < bytes; i++)
+        n |= (unsigned long)(*p)[i] << (i * 8);
+    *p += bytes;
+
+    /* sign-extend */
+    if (n & (1UL << (bytes * 8 - 1)))
+        return (long long)n - (1LL << (bytes * 8));
+    return n;
+}
+
+static int
+apply_binary_dbuf(const char *encoded)
+{
+    static unsigned char bin[MAX_BINARY_DBUF_LEN];
+    const unsigned char *p, *end;
+    int len, i = 0, skip, count;
+    struct nh_dbuf_entry *dbe;
+
+    len = base64_decode_binary(encoded, bin, sizeof bin);
+    if (len < 0)
+        return 0;
+
+    p = bin;
+    end = bin + len;
+    while (p < end) {
+        if (!get_varint(&p, end, &skip) || !get_varint(&p, end, &count))
+            return 0;
+        if (skip > ROWNO * COLNO - i ||
+            count > ROWNO * COLNO - i - skip ||
+            count > (end - p) / PACKED_DBUF_ENTRY_LEN)
+            return 0;
+
+        for (i += skip; count; count--, i++) {
+            dbe = &dbuf[i / COLNO][i % COLNO];
+            dbe->effect = get_le(&p, 4);
+            dbe->bg = get_le(&p, 2);
+            dbe->trap = get_le(&p, 2);
+            dbe->obj = get_le(&p, 2);
+            dbe->obj_mn = get_le(&p, 2);
+            dbe->mon = get_le(&p, 2);
+            dbe->monflags = get_le(&p, 2);
+            dbe->branding = get_le(&p, 2);
+            dbe->invis = !!(*p & 1);
+            dbe->visible = !!(*p & 2);
+            p++;
+        }
+    }
+
+    return 1;
+}
+
 static json_t *
 cmd_update_screen(json_t *params, int display_only)
 {
@@ -307,6 +410,15 @@ cmd_update_screen(json_t *params, int display_only)
         return NULL;
     }
 
+    /* Binary map data is only valid if we negotiated it at login. */
+    if (json_is_string(jdbuf) && binary_dbuf) {
+        if (apply_binary_dbuf(json_string_value(jdbuf)))
+            client_windowprocs.win_update_screen(dbuf, ux, uy);
+        else
+            print_error("Corrupt binary map data in cmd_update_screen");
+        return NULL;
+    }
+
     if (!json_is_array(jdbuf)) {
         print_error("Incorrect parameter in cmd_update_screen");
         return NULL;
@@ -41,6 +41,8 @@ extern const_char_p_const_p EXPORT(nh_get_copyright_banner) (void);
 /* log.c */
 extern enum nh_log_status EXPORT(nh_get_savegame_status) (
     int fd, struct nh_game_info *si);
+extern nh_bool EXPORT(nh_convert_savefile) (
+    int infd, int outfd, nh_bool to_binary);
 
 /* cmd.c */
 extern nh_cmd_desc_p EXPORT(nh_get_commands) (int *count);
@@ -58,6 +60,10 @@ extern nh_option_desc_p EXPORT(nh_get_options) (void);
 extern void EXPORT(nh_describe_pos) (
     int x, int y, struct nh_desc_buf *bufs, int *is_in);
 
+/* profile.c */
+extern void EXPORT(nh_set_profiling) (nh_bool enabled);
+extern void EXPORT(nh_get_profile) (struct nh_profile *out, nh_bool reset);
+
 /* role.c */
 extern nh_roles_info_p EXPORT(nh_get_roles) (void);
 extern char_p EXPORT(nh_build_plselection_prompt) (
@@ -872,6 +872,21 @@ struct nh_window_procs {
     void (*win_server_cancel) (void);
 };
 
+/* Engine paths timed by nh_get_profile(), for benchmarking. */
+enum nh_profile_section {
+    NHPROF_SAVEGAME,
+    NHPROF_MDIFFAPPLY,
+    NHPROF_DORECOVER,
+    NHPROF_VISION_RECALC,
+    NHPROF_MOVEMON,
+    NHPROF_COUNT
+};
+
+struct nh_profile {
+    unsigned long long calls[NHPROF_COUNT];
+    unsigned long long nanoseconds[NHPROF_COUNT];
+};
+
 /* typedefs for import/export */
 typedef char *char_p;
 typedef const char *const_char_p;
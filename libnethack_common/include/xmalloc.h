@@ -13,10 +13,9 @@ struct tm;
 #ifndef XMALLOC_H
 # define XMALLOC_H
 
-struct xmalloc_block {
-    void *mem;
-    struct xmalloc_block *next;
-};
+/* A chain of allocations. Only ever used via pointer (a NULL pointer being an
+   empty chain); the contents are private to xmalloc.c. */
+struct xmalloc_block;
 
 extern void *xmalloc(struct xmalloc_block **blocklist, size_t size);
 extern void xmalloc_cleanup(struct xmalloc_block **blocklist);
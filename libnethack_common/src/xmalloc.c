@@ -4,6 +4,8 @@
 /* NetHack may be freely redistributed.  See license for details. */
 
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <signal.h>
 #include <stdio.h>
 #include <time.h>
@@ -15,29 +17,111 @@
    record the pointers we allocate on chains, and after a specific point in
    time, we know that all pointers on the chain should have died (e.g. messages
    by the end of the turn, API returns by the next API call). Thus, at that
-   point, we can just clean up all the pointers at once. */
+   point, we can just clean up all the pointers at once.
+
+   Because nothing on a chain is freed individually, there's no need to give
+   each allocation its own malloc() (which is what this code used to do, along
+   with another malloc() for a list node). Instead, a chain is a list of
+   chunks, most recent first, and allocations are carved off the end of the
+   first chunk in order; allocations are typically tiny and numerous (the
+   message functions produce several per message), so this is much faster.
+   Each allocation is preceded by a header giving its size, so that xrealloc
+   knows how much to copy. Large allocations get a chunk of their own. */
+
+/* Everything we hand out has to be suitably aligned for any type. */
+union xmalloc_align {
+    long double ld;
+    long long ll;
+    double d;
+    void *p;
+    void (*fp)(void);
+};
+
+#define XM_ALIGN(n) (((n) + sizeof (union xmalloc_align) - 1) / \
+                     sizeof (union xmalloc_align) * \
+                     sizeof (union xmalloc_align))
+
+#define XM_CHUNK_SIZE 8192
+#define XM_CHUNK_HEADER XM_ALIGN(sizeof (struct xmalloc_block))
+#define XM_SIZE_HEADER XM_ALIGN(sizeof (size_t))
+#define XM_NO_LAST ((size_t)-1)
+
+struct xmalloc_block {
+    struct xmalloc_block *next;
+    size_t capacity;  /* number of bytes after the chunk header */
+    size_t used;      /* number of those bytes that have been handed out */
+    size_t last;      /* offset of the most recent allocation, or XM_NO_LAST */
+};
+
+#define chunk_data(b) ((char *)(b) + XM_CHUNK_HEADER)
+
+static struct xmalloc_block *
+new_chunk(size_t capacity)
+{
+    struct xmalloc_block *b = malloc(XM_CHUNK_HEADER + capacity);
+    if (!b)
+        return NULL;
+
+    b->next = NULL;
+    b->capacity = capacity;
+    b->used = 0;
+    b->last = XM_NO_LAST;
+    return b;
+}
+
+/* Allocates from the end of a chunk, which must have enough space. */
+static void *
+carve(struct xmalloc_block *b, size_t size)
+{
+    char *mem = chunk_data(b) + b->used;
+
+    *(size_t *)mem = size;
+    b->last = b->used;
+    b->used += XM_SIZE_HEADER + XM_ALIGN(size);
+    return mem + XM_SIZE_HEADER;
+}
 
 void *
 xmalloc(struct xmalloc_block **blocklist, size_t size)
 {
-    void *mem;
-    struct xmalloc_block *b;
+    struct xmalloc_block *b = *blocklist;
+    size_t needed;
 
-    mem = malloc(size);
-    if (!mem)
+    if (size > SIZE_MAX / 2)
         return NULL;
+    /* A zero-size allocation still gets a byte of its own, so that its
+       pointer lies inside the chunk and xrealloc can find it. */
+    if (size == 0)
+        size = 1;
+    needed = XM_SIZE_HEADER + XM_ALIGN(size);
+
+    if (b && b->capacity - b->used >= needed)
+        return carve(b, size);
+
+    if (needed > XM_CHUNK_SIZE / 4) {
+        /* A chunk of its own. We place it behind the current chunk (if there
+           is one), so that smaller allocations can continue to use the space
+           remaining there. */
+        struct xmalloc_block *big = new_chunk(needed);
+        if (!big)
+            return NULL;
+
+        if (b) {
+            big->next = b->next;
+            b->next = big;
+        } else
+            *blocklist = big;
+
+        return carve(big, size);
+    }
 
-    b = malloc(sizeof (struct xmalloc_block));
-    if (!b) {
-        free(mem);
+    b = new_chunk(XM_CHUNK_SIZE);
+    if (!b)
         return NULL;
-    }
 
-    b->mem = mem;
     b->next = *blocklist;
     *blocklist = b;
-
-    return mem;
+    return carve(b, size);
 }
 
 
@@ -50,7 +134,6 @@ xmalloc_cleanup(struct xmalloc_block **blocklist)
         b = *blocklist;
         *blocklist = b->next;
 
-        free(b->mem);
         free(b);
     }
 }
@@ -58,67 +141,92 @@ xmalloc_cleanup(struct xmalloc_block **blocklist)
 /* Resizes a pointer that's on an xmalloc chain.
 
    This is intended for use with pointers that have only just been allocated,
-   although it will work for any pointer on the chain.
+   although it will work for any pointer on the chain. Resizing the most recent
+   allocation on the chain can typically be done in place; anything else is
+   copied into a new allocation, and the old memory is reclaimed only when the
+   chain is cleaned up.
 
-   It can also be used to free a pointer "early", by setting size to 0. */
+   It can also be used to free a pointer "early", by setting size to 0 (although
+   this only releases memory in the case of the most recent allocation). */
 void *
 xrealloc(struct xmalloc_block **blocklist, void *ptr, size_t size)
 {
+    struct xmalloc_block *b;
+    size_t oldsize;
+    void *newptr;
+
     if (!ptr) /* same special case as realloc */
         return xmalloc(blocklist, size);
 
-    /* This loop effectively treats a blocklist as being defined recursively: a
-       blocklist contains a memory location and another (possibly NULL)
-       blocklist. This leads to the following neat method of looping over a
-       singly linked list in a way that allows deletion of elements. */
-    while (*blocklist) {
-        if ((*blocklist)->mem == ptr) {
+    /* Find the chunk that contains ptr. Comparing pointers into different
+       objects isn't defined by C11, so we compare them as integers; all we
+       need is for the mapping to be order-preserving within one object. */
+    for (b = *blocklist; b; b = b->next)
+        if ((uintptr_t)ptr > (uintptr_t)chunk_data(b) &&
+            (uintptr_t)ptr < (uintptr_t)(chunk_data(b) + b->used))
+            break;
 
-            if (size > 0) {
+    if (!b) {
+        /* We didn't find it. The correct reaction to memory corruption like
+           this is a segfault, the same way as a NULL dereference or the like.
 
-                void *newptr = realloc(ptr, size);
-                if (!newptr)
-                    return NULL;
+           C11 actually officially defines segfaults as something that exist,
+           although it doesn't require an implementation to produce them in
+           any situation other than a function explicitly saying "this
+           situation is a segfault"; that is, however, the situation we have
+           here. Some older non-UNIX compilers may not be aware of segfaults,
+           though, so we substitute an abort() in that situation. */
 
-                (*blocklist)->mem = newptr;
-                return newptr;
-                
-            } else {
+#ifdef SIGSEGV
+        raise(SIGSEGV);
+#endif
+        /* We alo substitute an abort if a SIGSEGV handler returned. (That
+           shouldn't happen either.) */
+        abort();
+    }
 
-                /* My reading of C11 implies that it's possible for realloc(ptr,
-                   0) to deallocate ptr, then allocate and return a valid block
-                   of memory (that cannot be dereferenced, due to being
-                   effectively zero bytes long). Obviously, this is stupid, but
-                   we may as well use free() to dodge the whole issue... */
+    oldsize = *(size_t *)((char *)ptr - XM_SIZE_HEADER);
 
-                struct xmalloc_block *oldblock = *blocklist;
-                (*blocklist) = (*blocklist)->next;
-                
-                free(ptr);
-                free(oldblock);
-                return NULL;
-            }
+    if (b->last != XM_NO_LAST &&
+        (char *)ptr == chunk_data(b) + b->last + XM_SIZE_HEADER) {
 
+        /* The most recent allocation in its chunk; we can resize it in place,
+           so long as it fits. */
+        if (size == 0) {
+            b->used = b->last;
+            b->last = XM_NO_LAST;
+            return NULL;
         }
-        blocklist = &((*blocklist)->next);
+
+        if (size <= SIZE_MAX / 2 &&
+            b->capacity - b->last >= XM_SIZE_HEADER + XM_ALIGN(size)) {
+            *(size_t *)((char *)ptr - XM_SIZE_HEADER) = size;
+            b->used = b->last + XM_SIZE_HEADER + XM_ALIGN(size);
+            return ptr;
+        }
+
+        /* It doesn't fit, so it has to move to a new chunk (and thus won't
+           end up in this chunk). We can reclaim the old space after the
+           copy. */
+        newptr = xmalloc(blocklist, size);
+        if (!newptr)
+            return NULL;
+
+        memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+        b->used = b->last;
+        b->last = XM_NO_LAST;
+        return newptr;
     }
 
-    /* We didn't find it. The correct reaction to memory corruption like this is
-       a segfault, the same way as a NULL dereference or the like.
+    if (size == 0)
+        return NULL;
 
-       C11 actually officially defines segfaults as something that exist,
-       although it doesn't require an implementation to produce them in any
-       situation other than a function explicitly saying "this situation is a
-       segfault"; that is, however, the situation we have here. Some older
-       non-UNIX compilers may not be aware of segfaults, though, so we
-       substitute an abort() in that situation. */
+    newptr = xmalloc(blocklist, size);
+    if (!newptr)
+        return NULL;
 
-#ifdef SIGSEGV
-    raise(SIGSEGV);
-#endif
-    /* We alo substitute an abort if a SIGSEGV handler returned. (That shouldn't
-       happen either.) */
-    abort();
+    memcpy(newptr, ptr, oldsize < size ? oldsize : size);
+    return newptr;
 }
 
 /* vasprintf, allocating on an xmalloc chain. */
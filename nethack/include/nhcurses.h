@@ -352,6 +352,9 @@ struct curses_symdef {
     short ch;   /* for non-unicode displays */
     nh_bool custom;     /* true if this is a custom value that was explicitly
                            changed by the user */
+    int tileno;         /* tile sequence number, worked out when the drawing
+                           info is loaded; for explosion and zap types, this
+                           is instead added to the symbol's tile number */
 };
 
 
@@ -628,6 +631,7 @@ extern void write_ui_config(void);
 /* outchars.c */
 extern void init_displaychars(void);
 extern void free_displaychars(void);
+extern void index_tile_table(void);
 extern unsigned long long dbe_substitution(struct nh_dbuf_entry *dbe);
 extern void print_tile(WINDOW *win, struct curses_symdef *api_name,
                        struct curses_symdef *api_type, int offset,
@@ -238,11 +238,10 @@ draw_map(int cx, int cy)
                     print_tile(mapwin, default_drawing->objects + dbyx->obj-1,
                                NULL, TILESEQ_OBJ_OFF, substitution);
             }
-            /* invisible monster symbol; just use the tile number directly, no
-               need to go via an API name because there is only one */
+            /* invisible monster symbol; there's only one, so its tile number
+               was set directly when the drawing info was loaded */
             if (dbyx->invis)
-                print_tile(mapwin, &(struct curses_symdef){
-                        .symname = invismonexplain},
+                print_tile(mapwin, default_drawing->invis,
                            NULL, TILESEQ_INVIS_OFF, substitution);
             /* monsters */
             if (dbyx->mon && dbyx->mon <= default_drawing->num_monsters)
@@ -27,6 +27,19 @@ nh_bool tiletable_is_cchar = 1;
 
 static void print_tile_number(WINDOW *, int, unsigned long long);
 
+/* The tile table, indexed by tile number. Each tile number's entries are in
+   tile_entries[first .. first + count - 1]; if count is 0, the tile is
+   missing from the tileset, and first is the entry we draw instead. */
+static struct tile_index {
+    int first;
+    int count;
+} *tile_index;
+
+static struct tile_entry {
+    unsigned long long substitutions;
+    unsigned long image;
+} *tile_entries;
+
 static struct curses_symdef *
 load_nh_symarray(const struct nh_symdef *src, int len)
 {
@@ -48,6 +61,44 @@ load_nh_symarray(const struct nh_symdef *src, int len)
 }
 
 
+/* Work out the tile number for every symbol in a curses_symdef array now, so
+   that we don't need to look the names up every time we draw something. */
+static void
+resolve_tilenos(struct curses_symdef *array, int len, int offset)
+{
+    int i;
+
+    for (i = 0; i < len; i++)
+        array[i].tileno = tileno_from_api_name(array[i].symname, NULL, offset);
+}
+
+
+/* Explosions and zaps are named by a symbol and a type. The tile sequence
+   places each type's symbols consecutively, so we store each symbol's tile
+   number for the first type, and the distance from there for each type. */
+static void
+resolve_paired_tilenos(struct curses_symdef *syms, int symslen,
+                       struct curses_symdef *types, int typeslen, int offset)
+{
+    int i, base;
+
+    for (i = 0; i < symslen; i++)
+        syms[i].tileno = typeslen ?
+            tileno_from_api_name(syms[i].symname, types[0].symname, offset) :
+            TILESEQ_INVALID_OFF;
+
+    base = symslen ? syms[0].tileno : TILESEQ_INVALID_OFF;
+    for (i = 0; i < typeslen; i++) {
+        int tileno = tileno_from_api_name(syms[0].symname, types[i].symname,
+                                          offset);
+
+        types[i].tileno = (tileno == TILESEQ_INVALID_OFF ||
+                           base == TILESEQ_INVALID_OFF) ?
+            TILESEQ_INVALID_OFF : tileno - base;
+    }
+}
+
+
 static struct curses_drawing_info *
 load_nh_drawing_info(const struct nh_drawing_info *orig)
 {
@@ -77,6 +128,19 @@ load_nh_drawing_info(const struct nh_drawing_info *orig)
     copy->zapsyms = load_nh_symarray(orig->zapsyms, NUMZAPCHARS);
     copy->swallowsyms = load_nh_symarray(orig->swallowsyms, NUMSWALLOWCHARS);
 
+    resolve_tilenos(copy->bgelements, copy->num_bgelements, TILESEQ_CMAP_OFF);
+    resolve_tilenos(copy->traps, copy->num_traps, TILESEQ_TRAP_OFF);
+    resolve_tilenos(copy->objects, copy->num_objects, TILESEQ_OBJ_OFF);
+    resolve_tilenos(copy->monsters, copy->num_monsters, TILESEQ_MON_OFF);
+    resolve_tilenos(copy->warnings, copy->num_warnings, TILESEQ_WARN_OFF);
+    resolve_tilenos(copy->effects, copy->num_effects, TILESEQ_EFFECT_OFF);
+    resolve_tilenos(copy->swallowsyms, NUMSWALLOWCHARS, TILESEQ_SWALLOW_OFF);
+    resolve_paired_tilenos(copy->explsyms, NUMEXPCHARS, copy->expltypes,
+                           copy->num_expltypes, TILESEQ_EXPLODE_OFF);
+    resolve_paired_tilenos(copy->zapsyms, NUMZAPCHARS, copy->zaptypes,
+                           copy->num_zaptypes, TILESEQ_ZAP_OFF);
+    copy->invis->tileno = TILESEQ_INVIS_OFF;
+
     return copy;
 }
 
@@ -368,8 +432,8 @@ get_tt_number(int tt_offset)
     return l;
 }
 
-static void
-print_tile_number(WINDOW *win, int tileno, unsigned long long substitutions)
+static int
+search_tile_table(int tileno, unsigned long long substitutions)
 {
     /* Find the tile in question in the tile table. The rules:
        - The tile numbers must be equal;
@@ -393,7 +457,7 @@ print_tile_number(WINDOW *win, int tileno, unsigned long long substitutions)
     int low = 0, high = ttelements;
 
     if (ttelements == 0)
-        return; /* no tile table */
+        return -1; /* no tile table */
 
     /* Invariant: tiles not in low .. high inclusive are definitely not the
        tile we're looking for */
@@ -434,10 +498,93 @@ print_tile_number(WINDOW *win, int tileno, unsigned long long substitutions)
     if (low >= ttelements)
         low = ttelements - 1;
 
+    return low;
+}
+
+
+/* Build tile_index and tile_entries from tiletable. This is called whenever
+   the tile table changes. */
+void
+index_tile_table(void)
+{
+    int ttelements = tiletable_len / 16;
+    int i;
+
+    free(tile_index);
+    free(tile_entries);
+    tile_index = NULL;
+    tile_entries = NULL;
+
+    if (ttelements == 0)
+        return;
+
+    tile_index = malloc(TILESEQ_COUNT * sizeof *tile_index);
+    tile_entries = malloc(ttelements * sizeof *tile_entries);
+    if (!tile_index || !tile_entries) {
+        free(tile_index);
+        free(tile_entries);
+        tile_index = NULL;
+        tile_entries = NULL;
+        return;     /* we can still use the tile table directly */
+    }
+
+    for (i = 0; i < TILESEQ_COUNT; i++)
+        tile_index[i].count = 0;
+
+    /* The tile table is sorted by tile number, so each tile number's entries
+       are consecutive. */
+    for (i = 0; i < ttelements; i++) {
+        int tileno = get_tt_number(i * 16);
+
+        tile_entries[i].substitutions =
+            ((unsigned long long)get_tt_number(i * 16 + 4)) +
+            ((unsigned long long)get_tt_number(i * 16 + 8) << 32);
+        tile_entries[i].image = get_tt_number(i * 16 + 12);
+
+        if (tileno < 0 || tileno >= TILESEQ_COUNT)
+            continue;
+        if (!tile_index[tileno].count++)
+            tile_index[tileno].first = i;
+    }
+
+    /* Tiles that are missing get whatever the search would have found. */
+    for (i = 0; i < TILESEQ_COUNT; i++)
+        if (!tile_index[i].count)
+            tile_index[i].first = search_tile_table(i, 0);
+}
+
+
+static void
+print_tile_number(WINDOW *win, int tileno, unsigned long long substitutions)
+{
+    int entry;
+    unsigned long image;
+
+    if (tile_index && tileno >= 0 && tileno < TILESEQ_COUNT) {
+        /* Use the entry with the largest substitution number whose
+           substitutions are a subset of the ones we want, or the first entry
+           for the tile if there are none. */
+        int first = tile_index[tileno].first;
+
+        for (entry = first + tile_index[tileno].count - 1; entry > first;
+             entry--)
+            if ((tile_entries[entry].substitutions & substitutions) ==
+                tile_entries[entry].substitutions)
+                break;
+
+        image = tile_entries[entry].image;
+    } else {
+        entry = search_tile_table(tileno, substitutions);
+        if (entry < 0)
+            return; /* no tile table */
+
+        image = get_tt_number(entry * 16 + 12);
+    }
+
     if (tiletable_is_cchar)
-        curcchar = combine_cchar(curcchar, get_tt_number(low * 16 + 12));
+        curcchar = combine_cchar(curcchar, image);
     else
-        wset_tiles_tile(win, get_tt_number(low * 16 + 12));
+        wset_tiles_tile(win, image);
 }
 
 void
@@ -445,8 +592,11 @@ print_tile(WINDOW *win, struct curses_symdef *api_name,
            struct curses_symdef *api_type, int offset,
            unsigned long long substitutions)
 {
-    int tileno = tileno_from_api_name(
-        api_name->symname, api_type ? api_type->symname : NULL, offset);
+    int tileno = api_name->tileno;
+
+    if (api_type && tileno != TILESEQ_INVALID_OFF)
+        tileno = api_type->tileno == TILESEQ_INVALID_OFF ?
+            TILESEQ_INVALID_OFF : tileno + api_type->tileno;
     /* TODO: better rendition for missing tiles than just using the unexplored
        area tile */
     if (tileno == TILESEQ_INVALID_OFF) tileno = 0;
@@ -461,6 +611,7 @@ static const char *const furthest_backgrounds[] = {
 
 static int furthest_background_tileno[sizeof furthest_backgrounds /
                                       sizeof *furthest_backgrounds];
+static int unexplored_tileno;
 static nh_bool furthest_background_tileno_needs_initializing = 1;
 
 void
@@ -474,6 +625,8 @@ print_background_tile(WINDOW *win, struct nh_dbuf_entry *dbe)
             furthest_background_tileno[i] =
                 tileno_from_name(furthest_backgrounds[i], TILESEQ_CMAP_OFF);
         }
+        unexplored_tileno = tileno_from_name("unexplored area",
+                                             TILESEQ_CMAP_OFF);
         furthest_background_tileno_needs_initializing = 0;
     }
 
@@ -482,9 +635,7 @@ print_background_tile(WINDOW *win, struct nh_dbuf_entry *dbe)
 
     if (!settings.visible_rock &&
         !strcmp("stone", default_drawing->bgelements[dbe->bg].symname))
-        print_tile_number(win, tileno_from_name("unexplored area",
-                                                TILESEQ_CMAP_OFF),
-                          substitutions);
+        print_tile_number(win, unexplored_tileno, substitutions);
     else
         print_tile(win, default_drawing->bgelements + dbe->bg,
                    NULL, TILESEQ_CMAP_OFF, substitutions);
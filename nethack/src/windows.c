@@ -150,6 +150,7 @@ load_tile_file(const char *tilebase, char *store_tilename_in)
         free(tiletable);
         tiletable = NULL;
         tiletable_len = 0;
+        index_tile_table();
     } else
         *store_tilename_in = '\0';
 
@@ -257,6 +258,7 @@ load_tile_file(const char *tilebase, char *store_tilename_in)
         return;
     }
     tiletable_len = ttlen;
+    index_tile_table();
 }
 
 static int
@@ -45,6 +45,13 @@
 #  define DEFAULT_CLIENT_TIMEOUT (15 * 60)      /* 15 minutes */
 # endif
 
+# if !defined(DEFAULT_WORKERS)
+#  define DEFAULT_WORKERS 8     /* idle workers kept by the front end */
+# endif
+
+# define AUTH_MAXLEN 4096
+# define AUTHBUFSIZE (AUTH_MAXLEN + 2)
+
 
 enum getgame_result {
     GGR_NOT_FOUND,
@@ -58,6 +65,8 @@ struct settings {
     char *pidfile;
     int client_timeout;
     char *dbhost, *dbname, *dbport, *dbuser, *dbpass;
+    char *port;         /* if set, run as a front-end daemon on this port */
+    int workers;
 };
 
 
@@ -91,6 +100,7 @@ extern int gamefd;
 extern long gameid;
 extern const struct client_command clientcmd[];
 extern struct nh_player_info player_info;
+extern int binary_dbuf;
 
 /*---------------------------------------------------------------------------*/
 
@@ -115,6 +125,8 @@ extern void free_config(void);
 extern int init_database(void);
 extern int check_database(void);
 extern void close_database(void);
+extern void close_database_after_fork(void);
+extern int db_connection_ok(void);
 extern int db_auth_user(const char *name, const char *pass);
 extern int db_register_user(const char *name, const char *pass,
                             const char *email);
@@ -137,6 +149,9 @@ extern void db_add_topten_entry(int gid, int points, int hp, int maxhp,
                                 int deaths, int end_how, const char *death,
                                 const char *entrytxt);
 
+/* frontend.c */
+extern noreturn void run_frontend(void);
+
 /* log.c */
 extern void log_msg(const char *fmt, ...);
 extern int begin_logging(void);
@@ -149,6 +164,7 @@ extern int init_workdir(void);
 
 /* server.c */
 extern noreturn void runserver(void);
+extern noreturn void runserver_authenticated(int userid);
 extern noreturn void exit_server(int exitstatus, int coredumpsignal);
 
 /* winprocs.c */
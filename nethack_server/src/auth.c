@@ -9,6 +9,9 @@
 #include "nhserver.h"
 #include <wctype.h>
 
+/* Whether the client asked for map updates in binary form. */
+int binary_dbuf = 0;
+
 
 /* check various rules that apply to names:
  * - it must be a valid multibyte (UTF8) string
@@ -79,6 +82,7 @@ auth_user(char *authbuf, int *is_reg)
     name = json_object_get(cmd, "username");
     pass = json_object_get(cmd, "password");
     email = json_object_get(cmd, "email");      /* is null for auth */
+    binary_dbuf = json_is_true(json_object_get(cmd, "binary_dbuf"));
 
     if (!name || !pass) {
         log_msg("auth packet is missing name or password");
@@ -152,6 +156,9 @@ auth_send_result(int sockfd, enum authresult result, int is_reg)
     jval =
         json_pack("{s:{si,s:[i,i,i]}}", key, "return", result,
                   "version", VERSION_MAJOR, VERSION_MINOR, PATCHLEVEL);
+    if (binary_dbuf && result == AUTH_SUCCESS_NEW)
+        json_object_set_new(json_object_get(jval, key), "binary_dbuf",
+                            json_true());
     jstr = json_dumps(jval, JSON_COMPACT);
     len = strlen(jstr);
     written = 0;
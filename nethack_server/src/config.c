@@ -39,7 +39,8 @@ struct { const char *const name; size_t offset; } settings_map[] = {
     SETTINGS_MAP_ENTRY(dbport),
     SETTINGS_MAP_ENTRY(dbuser),
     SETTINGS_MAP_ENTRY(dbpass),
-    SETTINGS_MAP_ENTRY(dbname)
+    SETTINGS_MAP_ENTRY(dbname),
+    SETTINGS_MAP_ENTRY(port)
 };
 
 static int
@@ -98,6 +99,17 @@ parse_config_line(char *line)
             return FALSE;
         }
     }
+    else if (!strcmp(line, "workers")) {
+        if (!settings.workers)
+            settings.workers = atoi(val);
+
+        if (settings.workers < 1 || settings.workers > 1000) {
+            fprintf(stderr,
+                    "Error: the value for workers must be in the"
+                    " range [1, 1000].\n");
+            return FALSE;
+        }
+    }
     else
         /* it's a warning, no need to return FALSE */
         fprintf(stderr, "Warning: unrecognized option \"%s\".\n", line);
@@ -201,6 +213,9 @@ setup_defaults(void)
 
     if (!settings.client_timeout)
         settings.client_timeout = DEFAULT_CLIENT_TIMEOUT;
+
+    if (!settings.workers)
+        settings.workers = DEFAULT_WORKERS;
 }
 
 
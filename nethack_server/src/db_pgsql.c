@@ -8,16 +8,14 @@
 
 #include "nhserver.h"
 
+#include <time.h>
+
 #if defined(LIBPQFE_IN_SUBDIR)
 # include <postgresql/libpq-fe.h>
 #else
 # include <libpq-fe.h>
 #endif
 
-/* prepared statement names */
-#define PREP_AUTH       "auth_user"
-#define PREP_REGISTER   "register_user"
-
 /* SQL statements used */
 static const char SQL_init_user_table[] =
     "CREATE TABLE users(" "uid SERIAL PRIMARY KEY, "
@@ -54,9 +52,7 @@ static const char SQL_check_pgcrypto[] =
 static const char SQL_register_user[] =
     "INSERT INTO users (name, pwhash, email, ts, reg_ts) "
     "VALUES ($1::varchar(50), crypt($2::text, gen_salt('bf', 8)), $3::text, "
-    "'now', 'now');";
-
-static const char SQL_last_reg_id[] = "SELECT currval('users_uid_seq');";
+    "'now', 'now') RETURNING uid;";
 
 static const char SQL_auth_user[] =
     "SELECT uid, pwhash = crypt($2::text, pwhash) AS auth_ok " "FROM   users "
@@ -79,13 +75,12 @@ static const char SQL_add_game[] =
     "INSERT INTO games (filename, role, race, gender, alignment, mode, moves, "
     "depth, owner, plname, level_desc, ts, start_ts) "
     "VALUES ($1::text, $2::text, $3::text, $4::text, $5::text, "
-    "$6::integer, 1, 1, $7::integer, $8::text, $9::text, 'now', 'now')";
+    "$6::integer, 1, 1, $7::integer, $8::text, $9::text, 'now', 'now') "
+    "RETURNING gid;";
 
 static const char SQL_delete_game[] =
     "DELETE FROM games WHERE owner = $1::integer AND gid = $2::integer;";
 
-static const char SQL_last_game_id[] = "SELECT currval('games_gid_seq');";
-
 static const char SQL_update_game[] =
     "UPDATE games "
     "SET ts = 'now', moves = $2::integer, depth = $3::integer, level_desc = "
@@ -109,9 +104,99 @@ static const char SQL_add_topten_entry[] =
     "$5::integer, $6::integer, $7::text, $8::text);";
 
 
+/* Everything except the schema checks is run as a prepared statement. Each
+   statement is prepared the first time it's used on a connection; most
+   connections only use a few of them, but use those repeatedly. */
+enum prepared_statement {
+    PS_AUTH_USER,
+    PS_REGISTER_USER,
+    PS_GET_USER_INFO,
+    PS_UPDATE_USER_TS,
+    PS_SET_USER_EMAIL,
+    PS_SET_USER_PASSWORD,
+    PS_ADD_GAME,
+    PS_UPDATE_GAME,
+    PS_DELETE_GAME,
+    PS_SET_GAME_DONE,
+    PS_LIST_GAMES,
+    PS_ADD_TOPTEN_ENTRY,
+    PS_COUNT
+};
+
+static struct {
+    const char *const name;
+    const char *const sql;
+    const int nparams;
+    int prepared;               /* on the current connection */
+} prepared_statements[PS_COUNT] = {
+    [PS_AUTH_USER] = {"auth_user", SQL_auth_user, 2},
+    [PS_REGISTER_USER] = {"register_user", SQL_register_user, 3},
+    [PS_GET_USER_INFO] = {"get_user_info", SQL_get_user_info, 1},
+    [PS_UPDATE_USER_TS] = {"update_user_ts", SQL_update_user_ts, 1},
+    [PS_SET_USER_EMAIL] = {"set_user_email", SQL_set_user_email, 2},
+    [PS_SET_USER_PASSWORD] = {"set_user_password", SQL_set_user_password, 2},
+    [PS_ADD_GAME] = {"add_game", SQL_add_game, 9},
+    [PS_UPDATE_GAME] = {"update_game", SQL_update_game, 4},
+    [PS_DELETE_GAME] = {"delete_game", SQL_delete_game, 2},
+    [PS_SET_GAME_DONE] = {"set_game_done", SQL_set_game_done, 1},
+    [PS_LIST_GAMES] = {"list_games", SQL_list_games, 4},
+    [PS_ADD_TOPTEN_ENTRY] = {"add_topten_entry", SQL_add_topten_entry, 8},
+};
+
+/* The users.ts and games.ts columns record when a user or game was last
+   active; they don't need to be accurate to the second, so we don't write
+   them after every single command. */
+#define TS_UPDATE_INTERVAL 60   /* seconds */
+
+static time_t user_ts_written;
+static int user_ts_pending_uid;
+
+static struct {
+    int gid, moves, depth;
+    char levdesc[128];
+    time_t written;
+} last_game_update;
+
+/* Bump this whenever the tables change, so that servers that have verified an
+   older schema check it again. */
+#define SCHEMA_VERSION 1
+
 static PGconn *conn;
 
 
+static void
+forget_prepared_statements(void)
+{
+    int i;
+
+    for (i = 0; i < PS_COUNT; i++)
+        prepared_statements[i].prepared = FALSE;
+}
+
+
+static PGresult *
+exec_prepared(enum prepared_statement ps, const char *const *params)
+{
+    PGresult *res;
+
+    if (!prepared_statements[ps].prepared) {
+        res = PQprepare(conn, prepared_statements[ps].name,
+                        prepared_statements[ps].sql,
+                        prepared_statements[ps].nparams, NULL);
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            /* Let the caller report the error. */
+            return res;
+        }
+        PQclear(res);
+        prepared_statements[ps].prepared = TRUE;
+    }
+
+    return PQexecPrepared(conn, prepared_statements[ps].name,
+                          prepared_statements[ps].nparams, params,
+                          NULL, NULL, 0);
+}
+
+
 /*
  * init the database connection.
  */
@@ -121,6 +206,8 @@ init_database(void)
     if (conn)
         close_database();
 
+    forget_prepared_statements();
+
     conn =
         PQsetdbLogin(settings.dbhost, settings.dbport, NULL, NULL,
                      settings.dbname, settings.dbuser, settings.dbpass);
@@ -133,6 +220,7 @@ init_database(void)
 
 err:
     PQfinish(conn);
+    conn = NULL;
     return FALSE;
 }
 
@@ -168,6 +256,66 @@ check_create_table(const char *tablename, const char *create_stmt)
 }
 
 
+/*
+ * Once the tables have been checked, we leave a note in the work directory
+ * saying which database they were checked in, so that we don't need to check
+ * again every time a server process starts. (Delete the file to force a
+ * recheck.)
+ */
+static void
+schema_marker(char *buf, size_t buflen, char *contents, size_t contentslen)
+{
+    snprintf(buf, buflen, "%s/schema_verified", settings.workdir);
+    snprintf(contents, contentslen, "%d %s %s %s %s\n", SCHEMA_VERSION,
+             settings.dbhost ? settings.dbhost : "",
+             settings.dbport ? settings.dbport : "",
+             settings.dbname ? settings.dbname : "",
+             settings.dbuser ? settings.dbuser : "");
+}
+
+
+static int
+schema_already_verified(void)
+{
+    char filename[1024], expected[1024], found[1024];
+    int fd, len;
+
+    schema_marker(filename, sizeof filename, expected, sizeof expected);
+
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return FALSE;
+    len = read(fd, found, sizeof found - 1);
+    close(fd);
+    if (len <= 0)
+        return FALSE;
+    found[len] = '\0';
+
+    return !strcmp(found, expected);
+}
+
+
+static void
+mark_schema_verified(void)
+{
+    char filename[1024], contents[1024], tmpname[1040];
+    int fd, len, ok;
+
+    schema_marker(filename, sizeof filename, contents, sizeof contents);
+    snprintf(tmpname, sizeof tmpname, "%s.%d", filename, (int)getpid());
+
+    fd = open(tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+        return;
+    len = strlen(contents);
+    ok = write(fd, contents, len) == len;
+    close(fd);
+
+    if (!ok || rename(tmpname, filename) == -1)
+        unlink(tmpname);
+}
+
+
 /*
  * check the database tables and create them if necessary. Also check for the
  * existence of the crypt function
@@ -177,6 +325,9 @@ check_database(void)
 {
     PGresult *res;
 
+    if (schema_already_verified())
+        return TRUE;
+
     /* 
      * Perform a quick check for the presence of the pgcrypto extension:
      * A function crypt(text, text) must exist.
@@ -198,29 +349,13 @@ check_database(void)
         !check_create_table("topten", SQL_init_topten_table))
         goto err;
 
-    /* 
-     * Create prepared statements
-     */
-    res = PQprepare(conn, PREP_REGISTER, SQL_register_user, 0, NULL);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "prepare statement failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        goto err;
-    }
-    PQclear(res);
-
-    res = PQprepare(conn, PREP_AUTH, SQL_auth_user, 0, NULL);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        fprintf(stderr, "prepare statement failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        goto err;
-    }
-    PQclear(res);
+    mark_schema_verified();
 
     return TRUE;
 
 err:
     PQfinish(conn);
+    conn = NULL;
     return FALSE;
 }
 
@@ -228,8 +363,42 @@ err:
 void
 close_database(void)
 {
+    /* Write any timestamp that we held back. */
+    if (conn && user_ts_pending_uid) {
+        user_ts_written = 0;
+        db_update_user_ts(user_ts_pending_uid);
+    }
+
     PQfinish(conn);
     conn = NULL;
+    forget_prepared_statements();
+}
+
+
+/*
+ * Forget about a database connection inherited over fork() (which belongs to
+ * the parent process), without disturbing it. PQfinish would tell the server
+ * that the connection is being closed, so close the socket out from under it
+ * first, so that the goodbye message goes nowhere.
+ */
+void
+close_database_after_fork(void)
+{
+    if (!conn)
+        return;
+
+    close(PQsocket(conn));
+    PQfinish(conn);
+    conn = NULL;
+    forget_prepared_statements();
+    user_ts_pending_uid = 0;
+}
+
+
+int
+db_connection_ok(void)
+{
+    return conn && PQstatus(conn) == CONNECTION_OK;
 }
 
 
@@ -241,7 +410,7 @@ db_auth_user(const char *name, const char *pass)
     int uid, auth_ok, col;
     const char *uidstr;
 
-    res = PQexecPrepared(conn, PREP_AUTH, 2, params, NULL, NULL, 0);
+    res = exec_prepared(PS_AUTH_USER, params);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
         log_msg("db_auth_user failed: %s\n", PQerrorMessage(conn));
         PQclear(res);
@@ -268,18 +437,9 @@ db_register_user(const char *name, const char *pass, const char *email)
     int uid;
     const char *uidstr;
 
-    res = PQexecPrepared(conn, PREP_REGISTER, 3, params, NULL, NULL, 0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-        log_msg("db_register_user failed: %s", PQerrorMessage(conn));
-        PQclear(res);
-        return 0;
-    }
-    PQclear(res);
-
-    res = PQexec(conn, SQL_last_reg_id);
+    res = exec_prepared(PS_REGISTER_USER, params);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
-        log_msg("db_register_user get last id failed: %s",
-                PQerrorMessage(conn));
+        log_msg("db_register_user failed: %s", PQerrorMessage(conn));
         PQclear(res);
         return 0;
     }
@@ -297,14 +457,11 @@ db_get_user_info(int uid, struct user_info *info)
     PGresult *res;
     char uidstr[16];
     const char *const params[] = { uidstr };
-    const int paramFormats[] = { 0 };   /* text format */
     int col;
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
 
-    res =
-        PQexecParams(conn, SQL_get_user_info, 1, NULL, params, NULL,
-                     paramFormats, 0);
+    res = exec_prepared(PS_GET_USER_INFO, params);
     if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
         log_msg("db_get_user_info error: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -324,21 +481,30 @@ db_get_user_info(int uid, struct user_info *info)
 }
 
 
+/* This is called for every command the client sends, so we only actually
+   write the timestamp every so often (and when the connection's closed). */
 void
 db_update_user_ts(int uid)
 {
     PGresult *res;
     char uidstr[16];
     const char *const params[] = { uidstr };
-    const int paramFormats[] = { 0 };   /* text format */
+    time_t now = time(NULL);
+
+    if (now - user_ts_written < TS_UPDATE_INTERVAL &&
+        (uid == user_ts_pending_uid || !user_ts_pending_uid)) {
+        user_ts_pending_uid = uid;
+        return;
+    }
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
-    res =
-        PQexecParams(conn, SQL_update_user_ts, 1, NULL, params, NULL,
-                     paramFormats, 0);
+    res = exec_prepared(PS_UPDATE_USER_TS, params);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
         log_msg("update_user_ts error: %s", PQerrorMessage(conn));
     PQclear(res);
+
+    user_ts_written = now;
+    user_ts_pending_uid = 0;
 }
 
 
@@ -348,14 +514,11 @@ db_set_user_email(int uid, const char *email)
     PGresult *res;
     char uidstr[16];
     const char *const params[] = { uidstr, email };
-    const int paramFormats[] = { 0, 0 };
     const char *numrows;
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
 
-    res =
-        PQexecParams(conn, SQL_set_user_email, 2, NULL, params, NULL,
-                     paramFormats, 0);
+    res = exec_prepared(PS_SET_USER_EMAIL, params);
     numrows = PQcmdTuples(res);
     if (PQresultStatus(res) == PGRES_COMMAND_OK && atoi(numrows) == 1) {
         PQclear(res);
@@ -372,14 +535,11 @@ db_set_user_password(int uid, const char *password)
     PGresult *res;
     char uidstr[16];
     const char *const params[] = { uidstr, password };
-    const int paramFormats[] = { 0, 0 };
     const char *numrows;
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
 
-    res =
-        PQexecParams(conn, SQL_set_user_password, 2, NULL, params, NULL,
-                     paramFormats, 0);
+    res = exec_prepared(PS_SET_USER_PASSWORD, params);
     numrows = PQcmdTuples(res);
     if (PQresultStatus(res) == PGRES_COMMAND_OK && atoi(numrows) == 1) {
         PQclear(res);
@@ -401,29 +561,20 @@ db_add_new_game(int uid, const char *filename, const char *role,
     const char *const params[] = { filename, role, race, gend,
         align, modestr, uidstr, plname, levdesc
     };
-    const int paramFormats[] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
     const char *gameid_str;
     int gid;
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
     snprintf(modestr, sizeof(modestr), "%d", mode);
 
-    res =
-        PQexecParams(conn, SQL_add_game, 9, NULL, params, NULL, paramFormats,
-                     0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+    res = exec_prepared(PS_ADD_GAME, params);
+    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
         log_msg("db_add_new_game error while adding (%s - %s): %s", plname,
                 filename, PQerrorMessage(conn));
         PQclear(res);
         return 0;
     }
 
-    res = PQexec(conn, SQL_last_game_id);
-    if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) == 0) {
-        PQclear(res);
-        return 0;
-    }
-
     gameid_str = PQgetvalue(res, 0, 0);
     gid = atoi(gameid_str);
     PQclear(res);
@@ -432,23 +583,40 @@ db_add_new_game(int uid, const char *filename, const char *role,
 }
 
 
+/* Leaving a game typically updates it more than once (e.g. both exit_game
+   and the end of play_game do so), so we skip updates that wouldn't change
+   anything but the timestamp, unless the timestamp is getting old. */
 void
 db_update_game(int game, int moves, int depth, const char *levdesc)
 {
     PGresult *res;
     char gidstr[16], movesstr[16], depthstr[16];
     const char *const params[] = { gidstr, movesstr, depthstr, levdesc };
-    const int paramFormats[] = { 0, 0, 0, 0 };
+    time_t now = time(NULL);
+
+    if (game == last_game_update.gid && moves == last_game_update.moves &&
+        depth == last_game_update.depth &&
+        !strncmp(levdesc, last_game_update.levdesc,
+                 sizeof last_game_update.levdesc) &&
+        now - last_game_update.written < TS_UPDATE_INTERVAL)
+        return;
 
     snprintf(gidstr, sizeof(gidstr), "%d", game);
     snprintf(movesstr, sizeof(movesstr), "%d", moves);
     snprintf(depthstr, sizeof(depthstr), "%d", depth);
 
-    res =
-        PQexecParams(conn, SQL_update_game, 4, NULL, params, NULL, paramFormats,
-                     0);
-    if (PQresultStatus(res) != PGRES_COMMAND_OK)
+    res = exec_prepared(PS_UPDATE_GAME, params);
+    if (PQresultStatus(res) != PGRES_COMMAND_OK) {
         log_msg("update_game_ts error: %s", PQerrorMessage(conn));
+        last_game_update.gid = 0;
+    } else {
+        last_game_update.gid = game;
+        last_game_update.moves = moves;
+        last_game_update.depth = depth;
+        strncpy(last_game_update.levdesc, levdesc,
+                sizeof last_game_update.levdesc);
+        last_game_update.written = now;
+    }
     PQclear(res);
 }
 
@@ -458,14 +626,11 @@ db_delete_game(int uid, int gid)
     PGresult *res;
     char uidstr[16], gidstr[16];
     const char *const params[] = { uidstr, gidstr };
-    const int paramFormats[] = { 0, 0 };
 
     snprintf(uidstr, sizeof(uidstr), "%d", uid);
     snprintf(gidstr, sizeof(gidstr), "%d", gid);
 
-    res =
-        PQexecParams(conn, SQL_delete_game, 2, NULL, params, NULL, paramFormats,
-                     0);
+    res = exec_prepared(PS_DELETE_GAME, params);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
         log_msg("db_delete_game error: %s", PQerrorMessage(conn));
 
@@ -481,7 +646,6 @@ db_game_name_core(int completed, int uid, int gid, int limit, int *count)
     struct gamefile_info *files;
     char uidstr[16], gidstr[16], complstr[16], limitstr[16];
     const char *const params[] = { uidstr, complstr, gidstr, limitstr };
-    const int paramFormats[] = { 0, 0, 0, 0 };
     const char *const fmtstr = completed ? "%s/completed/%s/%s" :
         "%s/save/%s/%s";
 
@@ -493,9 +657,7 @@ db_game_name_core(int completed, int uid, int gid, int limit, int *count)
     snprintf(complstr, sizeof(complstr), "%d", !!completed);
     snprintf(limitstr, sizeof(limitstr), "%d", limit);
 
-    res =
-        PQexecParams(conn, SQL_list_games, 4, NULL, params, NULL, paramFormats,
-                     0);
+    res = exec_prepared(PS_LIST_GAMES, params);
     if (PQresultStatus(res) != PGRES_TUPLES_OK) {
         log_msg("list_games error: %s", PQerrorMessage(conn));
         PQclear(res);
@@ -561,7 +723,6 @@ db_add_topten_entry(int gid, int points, int hp, int maxhp, int deaths,
     const char *const params[] = { gidstr, pointstr, hpstr, maxhpstr,
         dcountstr, endstr, death, entrytxt
     };
-    const int paramFormats[] = { 0, 0, 0, 0, 0, 0, 0, 0 };
 
     snprintf(gidstr, sizeof(gidstr), "%d", gid);
     snprintf(pointstr, sizeof(pointstr), "%d", points);
@@ -570,18 +731,13 @@ db_add_topten_entry(int gid, int points, int hp, int maxhp, int deaths,
     snprintf(dcountstr, sizeof(dcountstr), "%d", deaths);
     snprintf(endstr, sizeof(endstr), "%d", end_how);
 
-    res =
-        PQexecParams(conn, SQL_add_topten_entry, 8, NULL, params, NULL,
-                     paramFormats, 0);
+    res = exec_prepared(PS_ADD_TOPTEN_ENTRY, params);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
         log_msg("add_topten_entry error: %s", PQerrorMessage(conn));
     PQclear(res);
 
-    /* note: the params and paramFormats arrays are re-used, but only the 1.
-       entry matters */
-    res =
-        PQexecParams(conn, SQL_set_game_done, 1, NULL, params, NULL,
-                     paramFormats, 0);
+    /* note: the params array is re-used, but only the 1. entry matters */
+    res = exec_prepared(PS_SET_GAME_DONE, params);
     if (PQresultStatus(res) != PGRES_COMMAND_OK)
         log_msg("set_game_done error: %s", PQerrorMessage(conn));
     PQclear(res);
@@ -0,0 +1,617 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* The NetHack server may be freely redistributed under the terms of either:
+ *  - the NetHack license
+ *  - the GNU General Public license v2 or later
+ */
+
+/* The front-end daemon.
+
+   Normally, inetd spawns a fresh server process for each connection, which
+   then connects to the database, checks the tables exist, and authenticates
+   the user, before running the game. That works fine until many people
+   connect at once (e.g. after a server restart), at which point the
+   database has to deal with hundreds of simultaneous connections and schema
+   checks.
+
+   As an alternative, the server can be started with a port to listen on (the
+   -p option, or "port" in the config file). It then stays running, accepts
+   connections itself, and authenticates them all using a single database
+   connection, multiplexing the (possibly slow) clients with epoll. Each
+   authenticated connection is then passed (via SCM_RIGHTS) to a worker
+   process, which runs the game exactly as an inetd-spawned server process
+   would have done. A number of workers are forked in advance, and each has
+   already set up its own database connection by the time it's given a
+   connection to handle; each worker handles one connection, and is replaced
+   with a new worker once it's used. */
+
+#include "nhserver.h"
+
+#include <ctype.h>
+#include <signal.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#define AUTH_TIMEOUT 15         /* seconds */
+#define MAX_PENDING_AUTHS 1024
+#define MAX_EVENTS 64
+
+struct fe_conn {
+    int fd;
+    int listening;              /* a listening socket, not a connection */
+    time_t deadline;
+    int len;
+    char buf[AUTHBUFSIZE];
+    struct fe_conn *prev, *next;
+};
+
+struct worker {
+    pid_t pid;
+    int ctlfd;
+};
+
+/* What a worker is told along with its file descriptor. */
+struct handoff {
+    int userid;
+    int is_reg;
+    int binary_dbuf;
+};
+
+static int epfd = -1;
+static struct fe_conn *listeners[2];
+static int nlisteners;
+static struct fe_conn *pending;
+static int npending;
+static struct worker *idle_workers;
+static int nidle;
+static time_t last_replenish;
+static int pidfile_fd = -1;
+
+static noreturn void worker_main(int ctlfd);
+
+
+static void
+drop_connection(struct fe_conn *c)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+
+    if (c->prev)
+        c->prev->next = c->next;
+    else
+        pending = c->next;
+    if (c->next)
+        c->next->prev = c->prev;
+    npending--;
+
+    free(c);
+}
+
+
+static int
+spawn_worker(void)
+{
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+        log_msg("Could not create a socket pair for a worker: %s",
+                strerror(errno));
+        return FALSE;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        log_msg("Could not fork a worker: %s", strerror(errno));
+        close(sv[0]);
+        close(sv[1]);
+        return FALSE;
+    }
+
+    if (pid == 0) {
+        close(sv[0]);
+        worker_main(sv[1]);
+    }
+
+    close(sv[1]);
+    idle_workers[nidle].pid = pid;
+    idle_workers[nidle].ctlfd = sv[0];
+    nidle++;
+    return TRUE;
+}
+
+
+static void
+reap_children(void)
+{
+    pid_t pid;
+    int i, status;
+
+    /* This collects both idle workers and workers that are running games
+       (which are also our children). We only care about the former. */
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (i = 0; i < nidle; i++)
+            if (idle_workers[i].pid == pid)
+                break;
+        if (i == nidle)
+            continue;
+
+        log_msg("Idle worker %d exited unexpectedly.", (int)pid);
+        close(idle_workers[i].ctlfd);
+        idle_workers[i] = idle_workers[--nidle];
+    }
+}
+
+
+/* Tops up the pool of idle workers. This happens at most once per second, so
+   that if workers are failing on startup (say, because the database is down),
+   we don't spend all our time forking. */
+static void
+replenish_workers(void)
+{
+    time_t now = time(NULL);
+
+    if (now == last_replenish)
+        return;
+    last_replenish = now;
+
+    while (nidle < settings.workers)
+        if (!spawn_worker())
+            break;
+}
+
+
+static int
+send_connection(int ctlfd, int fd, const struct handoff *h)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof (int))];
+    } cbuf;
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+
+    memset(&msg, 0, sizeof msg);
+    memset(&cbuf, 0, sizeof cbuf);
+    iov.iov_base = (void *)h;
+    iov.iov_len = sizeof *h;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof cbuf.buf;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof (int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof fd);
+
+    do {
+        ret = sendmsg(ctlfd, &msg, 0);
+    } while (ret == -1 && errno == EINTR);
+
+    return ret == sizeof *h;
+}
+
+
+static int
+receive_connection(int ctlfd, struct handoff *h)
+{
+    struct msghdr msg;
+    struct iovec iov;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof (int))];
+    } cbuf;
+    struct cmsghdr *cmsg;
+    ssize_t ret;
+    int fd;
+
+    memset(&msg, 0, sizeof msg);
+    iov.iov_base = h;
+    iov.iov_len = sizeof *h;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf.buf;
+    msg.msg_controllen = sizeof cbuf.buf;
+
+    do {
+        ret = recvmsg(ctlfd, &msg, 0);
+    } while (ret == -1 && errno == EINTR && !termination_flag);
+
+    if (ret != sizeof *h)
+        return -1;
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS)
+        return -1;
+
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof fd);
+    return fd;
+}
+
+
+/* Passes an authenticated connection to an idle worker (forking one if
+   necessary). Returns FALSE if that turned out to be impossible. */
+static int
+hand_off(int fd, int userid, int is_reg)
+{
+    struct handoff h = {.userid = userid, .is_reg = is_reg,
+                        .binary_dbuf = binary_dbuf};
+    struct worker w;
+    int tries;
+
+    for (tries = 0; tries < 3; tries++) {
+        if (!nidle && !spawn_worker())
+            return FALSE;
+
+        w = idle_workers[--nidle];
+        if (send_connection(w.ctlfd, fd, &h)) {
+            close(w.ctlfd);
+            return TRUE;
+        }
+
+        /* The worker must have died; try another. */
+        log_msg("Could not hand a connection to worker %d: %s",
+                (int)w.pid, strerror(errno));
+        close(w.ctlfd);
+    }
+
+    return FALSE;
+}
+
+
+static void
+authenticate(struct fe_conn *c)
+{
+    int fd = c->fd, userid, is_reg, flags;
+
+    c->buf[c->len] = '\0';
+
+    /* Make sure our own database connection is still usable; if it isn't,
+       then reconnect. */
+    if (!db_connection_ok() && (!init_database() || !check_database())) {
+        log_msg("Lost the database connection; dropping a connection.");
+        drop_connection(c);
+        return;
+    }
+
+    userid = auth_user(c->buf, &is_reg);
+
+    /* From here on, the connection's no longer ours to multiplex. */
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    flags = fcntl(fd, F_GETFL);
+    fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+
+    if (userid <= 0) {
+        if (!userid) {
+            log_msg("Authentication failed: unknown user");
+            auth_send_result(fd, AUTH_FAILED_UNKNOWN_USER, is_reg);
+        } else {
+            log_msg("Authentication failed: wrong password");
+            auth_send_result(fd, AUTH_FAILED_BAD_PASSWORD, is_reg);
+        }
+    } else if (!hand_off(fd, userid, is_reg)) {
+        /* The worker sends the success reply once it has the connection, so
+           the client just sees the connection close. */
+        log_msg("No worker available for userid %d; disconnecting.",
+                userid);
+    }
+
+    drop_connection(c);
+}
+
+
+static void
+read_auth_data(struct fe_conn *c)
+{
+    int ret, pos;
+
+    ret = read(c->fd, c->buf + c->len, AUTH_MAXLEN - c->len);
+    if (ret == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (ret <= 0) {
+        drop_connection(c);
+        return;
+    }
+
+    c->len += ret;
+    if (c->len >= AUTH_MAXLEN) {
+        log_msg("Auth buffer overrun attempt? Peer disconnected.");
+        drop_connection(c);
+        return;
+    }
+
+    /* As in auth_connection, a JSON object always ends with '}'. Unlike there,
+       we don't need the auth to arrive in a single packet. */
+    pos = c->len - 1;
+    while (pos > 0 && isspace(c->buf[pos]))
+        pos--;
+
+    if (c->buf[pos] == '}')
+        authenticate(c);
+}
+
+
+static void
+accept_connections(int listenfd)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    struct epoll_event ev;
+    struct fe_conn *c;
+    int fd;
+
+    for (;;) {
+        addrlen = sizeof addr;
+        fd = accept(listenfd, (struct sockaddr *)&addr, &addrlen);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                log_msg("accept failed: %s", strerror(errno));
+            return;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        if (npending >= MAX_PENDING_AUTHS) {
+            log_msg("Too many unauthenticated connections; rejecting %s.",
+                    addr2str(&addr));
+            close(fd);
+            continue;
+        }
+
+        c = malloc(sizeof *c);
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->listening = FALSE;
+        c->deadline = time(NULL) + AUTH_TIMEOUT;
+        c->len = 0;
+        c->prev = NULL;
+        c->next = pending;
+        if (pending)
+            pending->prev = c;
+        pending = c;
+        npending++;
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            log_msg("epoll_ctl failed: %s", strerror(errno));
+            drop_connection(c);
+            continue;
+        }
+
+        log_msg("Connection from %s.", addr2str(&addr));
+    }
+}
+
+
+static void
+expire_pending(void)
+{
+    struct fe_conn *c, *next;
+    time_t now = time(NULL);
+
+    for (c = pending; c; c = next) {
+        next = c->next;
+        if (c->deadline <= now) {
+            /* As with timeouted_read, this is a silent disconnection. */
+            log_msg("Timeout during authentication. Disconnecting.");
+            drop_connection(c);
+        }
+    }
+}
+
+
+static int
+add_listener(int family, const char *port)
+{
+    struct addrinfo hints, *res, *ai;
+    struct epoll_event ev;
+    struct fe_conn *c;
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = family;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(NULL, port, &hints, &res) != 0)
+        return FALSE;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+        if (ai->ai_family == AF_INET6)
+            setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &one, sizeof one);
+
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 &&
+            listen(fd, SOMAXCONN) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd == -1)
+        return FALSE;
+
+    c = calloc(1, sizeof *c);
+    c->fd = fd;
+    c->listening = TRUE;
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        close(fd);
+        free(c);
+        return FALSE;
+    }
+
+    listeners[nlisteners++] = c;
+    return TRUE;
+}
+
+
+/* Runs in a newly forked worker: gets rid of the front end's resources, then
+   waits for a connection to handle. */
+static noreturn void
+worker_main(int ctlfd)
+{
+    struct fe_conn *c;
+    struct handoff h;
+    int i, fd;
+
+    close_database_after_fork();
+    close(epfd);
+    for (i = 0; i < nlisteners; i++)
+        close(listeners[i]->fd);
+    for (c = pending; c; c = c->next)
+        close(c->fd);
+    for (i = 0; i < nidle; i++)
+        close(idle_workers[i].ctlfd);
+    if (pidfile_fd != -1)
+        close(pidfile_fd);
+
+    if (!init_database())
+        exit(EXIT_FAILURE);
+
+    fd = receive_connection(ctlfd, &h);
+    close(ctlfd);
+    if (fd == -1) {
+        /* The front end shut down without giving us anything to do. */
+        close_database();
+        exit(EXIT_SUCCESS);
+    }
+
+    log_msg("Worker received a connection for userid %d.", h.userid);
+
+    /* inetd-spawned server processes talk over stdin and stdout, so we do
+       too. */
+    if (dup2(fd, 0) == -1 || dup2(fd, 1) == -1)
+        exit(EXIT_FAILURE);
+    if (fd > 1)
+        close(fd);
+
+    binary_dbuf = h.binary_dbuf;
+    auth_send_result(1, AUTH_SUCCESS_NEW, h.is_reg);
+    runserver_authenticated(h.userid);
+}
+
+
+/* Writes our pid to the pid file, and keeps a write lock on it for as long as
+   we're running. The lock is what tells the server's -k option that the pid in
+   the file is still ours (fcntl locks belong to a process, and disappear when
+   it exits), rather than a stale pid that might now belong to anything. */
+static void
+write_pidfile(void)
+{
+    struct flock fl = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+    char buf[32];
+    int len;
+
+    pidfile_fd = open(settings.pidfile, O_WRONLY | O_CREAT, 0644);
+    if (pidfile_fd == -1) {
+        log_msg("Could not write the pid file %s: %s", settings.pidfile,
+                strerror(errno));
+        return;
+    }
+    if (fcntl(pidfile_fd, F_SETLK, &fl) == -1) {
+        log_msg("Could not lock the pid file %s (is another front end "
+                "running?): %s", settings.pidfile, strerror(errno));
+        close(pidfile_fd);
+        pidfile_fd = -1;
+        return;
+    }
+
+    len = snprintf(buf, sizeof buf, "%d\n", (int)getpid());
+    if (ftruncate(pidfile_fd, 0) == -1 || write(pidfile_fd, buf, len) != len)
+        log_msg("Could not write the pid file %s: %s", settings.pidfile,
+                strerror(errno));
+}
+
+
+noreturn void
+run_frontend(void)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct fe_conn *c;
+    int i, n;
+
+    epfd = epoll_create1(0);
+    if (epfd == -1) {
+        fprintf(stderr, "Error: epoll_create1 failed: %s\n", strerror(errno));
+        exit_server(EXIT_FAILURE, 0);
+    }
+
+    /* Separate IPv6 and IPv4 sockets, like the two lines in inetd.conf. */
+    add_listener(AF_INET6, settings.port);
+    add_listener(AF_INET, settings.port);
+    if (!nlisteners) {
+        fprintf(stderr, "Error: could not listen on port %s.\n",
+                settings.port);
+        exit_server(EXIT_FAILURE, 0);
+    }
+
+    idle_workers = malloc(sizeof *idle_workers * settings.workers);
+    if (!idle_workers)
+        exit_server(EXIT_FAILURE, 0);
+
+    write_pidfile();
+    log_msg("Front end listening on port %s with %d workers.",
+            settings.port, settings.workers);
+
+    while (!termination_flag) {
+        replenish_workers();
+
+        n = epoll_wait(epfd, events, MAX_EVENTS, 1000);
+        if (n == -1 && errno != EINTR) {
+            log_msg("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (i = 0; i < n; i++) {
+            c = events[i].data.ptr;
+            if (c->listening)
+                accept_connections(c->fd);
+            else
+                read_auth_data(c);
+        }
+
+        expire_pending();
+        reap_children();
+    }
+
+    log_msg("Front end shutting down.");
+
+    /* Games in progress carry on; they're independent processes, just as they
+       would be with inetd. Idle workers see their control socket close, and
+       exit. */
+    for (i = 0; i < nidle; i++)
+        close(idle_workers[i].ctlfd);
+    while (pending)
+        drop_connection(pending);
+    for (i = 0; i < nlisteners; i++) {
+        close(listeners[i]->fd);
+        free(listeners[i]);
+    }
+    close(epfd);
+    free(idle_workers);
+    if (pidfile_fd != -1) {
+        unlink(settings.pidfile);
+        close(pidfile_fd);
+    }
+
+    exit_server(EXIT_SUCCESS, 0);
+}
+
+/* frontend.c */
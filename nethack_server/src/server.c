@@ -11,9 +11,6 @@
 #include <ctype.h>
 #include <sys/select.h>
 
-#define AUTH_MAXLEN 4096
-#define AUTHBUFSIZE (AUTH_MAXLEN + 2)
-
 static int outfd = 1; /* stdout */
 static int infd = 0;  /* stdin */
 
@@ -122,6 +119,14 @@ runserver(void)
         exit_server(EXIT_FAILURE, 0);
 }
 
+/* Used by the workers of the front-end daemon, which receive a connection that
+   the front end has already authenticated on stdin/stdout. */
+noreturn void
+runserver_authenticated(int userid)
+{
+    newclient(userid);
+}
+
 noreturn void
 exit_server(int exitstatus, int coredumpsignal)
 {
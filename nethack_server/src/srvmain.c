@@ -13,32 +13,54 @@
 
 #include "nhserver.h"
 
+#include <signal.h>
+
 struct settings settings;
 int termination_flag;
 
 
 static void print_usage(const char *progname);
 static int read_parameters(int argc, char *argv[], char **conffile,
-                           int *request_kill, int *show_message);
+                           int *request_kill, int *show_message,
+                           char **convert_format);
+static int signal_frontend(int sig);
+static int convert_savefile(const char *format, const char *infile,
+                            const char *outfile);
 
 
 int
 main(int argc, char *argv[])
 {
-    char *conffile = NULL;
+    char *conffile = NULL, *convert_format = NULL;
     int request_kill = 0, show_message = 0;
 
-    if (!read_parameters(argc, argv, &conffile, &request_kill, &show_message)) {
+    if (!read_parameters(argc, argv, &conffile, &request_kill, &show_message,
+                         &convert_format)) {
         print_usage(argv[0]);
         return 1;
     }
 
+    /* Converting a save file doesn't need anything else set up. */
+    if (convert_format) {
+        if (argc - optind != 2) {
+            print_usage(argv[0]);
+            return 1;
+        }
+        return !convert_savefile(convert_format, argv[optind],
+                                 argv[optind + 1]);
+    }
+
     /* read the config file; conffile = NULL means use the default. */
     if (!read_config(conffile))
         return 1;       /* error reading the config file */
     setup_defaults();
 
     if (request_kill) {
+        if (signal_frontend(SIGTERM)) {
+            fprintf(stderr, "The front-end daemon was told to shut down.\n");
+            fprintf(stderr, "Send SIGTERM to any game processes manually.\n");
+            return 0;
+        }
         fprintf(stderr, "There is no longer a centralized server daemon.\n");
         fprintf(stderr, "Send SIGTERM to the server processes manually.\n");
         return 0;
@@ -52,6 +74,18 @@ main(int argc, char *argv[])
 
     setup_signals();
 
+    if (settings.port) {
+        /* Front-end daemon mode: one database connection for everyone's
+           authentication, set up once. */
+        if (!init_workdir() || !init_database() || !check_database() ||
+            !begin_logging())
+            return 1;
+
+        log_msg("front-end daemon started");
+
+        run_frontend(); /* does not return */
+    }
+
     /* Init files and directories. Start logging last, so that the log is only
        created if startup succeeds. */
     if (!init_workdir() || !init_database() || !check_database() ||
@@ -69,10 +103,20 @@ print_usage(const char *progname)
     printf("Usage: %s [OPTIONS]\n", progname);
     printf("  -c <file name>   Config file to use insted of the default.\n");
     printf("  -l <file name>   Alternate log file name.\n");
+    printf("  -n <number>      Number of idle workers for the front-end\n");
+    printf("                     daemon to keep ready. Default: %d.\n",
+           DEFAULT_WORKERS);
+    printf("  -p <port>        Run as a front-end daemon listening on the\n");
+    printf("                     given port, rather than serving a single\n");
+    printf("                     connection on stdin/stdout (from inetd).\n");
     printf("  -t <seconds>     Client timeout in seconds. Default: %d.\n",
            DEFAULT_CLIENT_TIMEOUT);
     printf("  -w <directory>   Working directory which will store user\n");
     printf("                     details, saved games, high score etc.\n");
+    printf("  -x <format> <in> <out>\n");
+    printf("                   Convert the save file <in> to the given\n");
+    printf("                     format (text or binary), writing it to\n");
+    printf("                     <out>, then exit.\n");
     printf("\n");
     printf("  Database connection settings:\n");
     printf("  -H <string>      Hostname, ip address (v4 or v6) or unix socket\n");
@@ -91,12 +135,12 @@ print_usage(const char *progname)
 
 static int
 read_parameters(int argc, char *argv[], char **conffile, int *request_kill,
-                int *show_message)
+                int *show_message, char **convert_format)
 {
     int opt;
 
     while ((opt =
-            getopt(argc, argv, "a:c:D:H:kl:mo:t:u:w:")) != -1) {
+            getopt(argc, argv, "a:c:D:H:kl:mn:o:p:t:u:w:x:")) != -1) {
         switch (opt) {
         case 'a':
             settings.dbpass = strdup(optarg);
@@ -127,10 +171,24 @@ read_parameters(int argc, char *argv[], char **conffile, int *request_kill,
             *show_message = TRUE;
             break;
 
+        case 'n':
+            settings.workers = atoi(optarg);
+            if (settings.workers < 1 || settings.workers > 1000) {
+                fprintf(stderr,
+                        "Error: Silly value %s given as the worker count.\n",
+                        optarg);
+                return FALSE;
+            }
+            break;
+
         case 'o':
             settings.dbport = strdup(optarg);
             break;
 
+        case 'p':
+            settings.port = strdup(optarg);
+            break;
+
         case 't':
             settings.client_timeout = atoi(optarg);
             if (settings.client_timeout <= 30 ||
@@ -150,6 +208,15 @@ read_parameters(int argc, char *argv[], char **conffile, int *request_kill,
             settings.workdir = strdup(optarg);
             break;
 
+        case 'x':      /* convert a save file */
+            if (strcmp(optarg, "text") && strcmp(optarg, "binary")) {
+                fprintf(stderr, "Error: Unknown save file format %s.\n",
+                        optarg);
+                return FALSE;
+            }
+            *convert_format = optarg;
+            break;
+
         case 'h':      /* help */
             return FALSE;
 
@@ -163,4 +230,69 @@ read_parameters(int argc, char *argv[], char **conffile, int *request_kill,
 }
 
 
+/* Sends a signal to the front-end daemon, if one is running. The pid in the
+   pid file only counts if the front end still holds its lock on the file;
+   otherwise it's left over from a front end that died, and the pid might have
+   been reused by an unrelated process. */
+static int
+signal_frontend(int sig)
+{
+    struct flock fl = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+    FILE *pf = fopen(settings.pidfile, "r");
+    int pid;
+
+    if (!pf)
+        return FALSE;
+
+    if (fscanf(pf, "%d", &pid) != 1 || pid <= 0 ||
+        fcntl(fileno(pf), F_GETLK, &fl) == -1 || fl.l_type == F_UNLCK ||
+        fl.l_pid != pid) {
+        fclose(pf);
+        return FALSE;
+    }
+    fclose(pf);
+
+    return kill(pid, sig) == 0;
+}
+
+
+/* Converts a save file between the text and binary log formats. The original
+   file is left alone, so that it can be replaced by the new one once the
+   conversion has succeeded. Nothing stops the game being played meanwhile, and
+   turns played after the file was read would be lost by the replacement, so
+   this is meant for games that aren't in progress. */
+static int
+convert_savefile(const char *format, const char *infile, const char *outfile)
+{
+    int infd, outfd, ok;
+
+    infd = open(infile, O_RDONLY);
+    if (infd == -1) {
+        fprintf(stderr, "Error: Could not open %s: %s.\n", infile,
+                strerror(errno));
+        return FALSE;
+    }
+
+    outfd = open(outfile, O_WRONLY | O_CREAT | O_EXCL, 0660);
+    if (outfd == -1) {
+        fprintf(stderr, "Error: Could not create %s: %s.\n", outfile,
+                strerror(errno));
+        close(infd);
+        return FALSE;
+    }
+
+    ok = nh_convert_savefile(infd, outfd, !strcmp(format, "binary")) &&
+        fsync(outfd) == 0;
+    close(infd);
+    close(outfd);
+
+    if (!ok) {
+        fprintf(stderr, "Error: Could not convert %s (is the file damaged, "
+                "or is the disk full?).\n", infile);
+        unlink(outfile);
+    }
+    return ok;
+}
+
+
 /* srvmain.c */
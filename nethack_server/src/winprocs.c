@@ -297,12 +297,150 @@ srv_print_message(int action, int id, int turn, enum msg_channel msgc,
     add_display_data("print_message", jobj);
 }
 
+/* The binary form of a map delta (used if the client asked for it when
+   authenticating; see "update_screen" in doc/server_protocol.txt). Cells are
+   visited in row-major order, and the delta is a sequence of runs, each of
+   which is a count of unchanged cells to skip, a count of changed cells, and
+   then that many packed cells. */
+#define PACKED_DBUF_ENTRY_LEN 19
+#define MAX_BINARY_DBUF_LEN (ROWNO * COLNO * (PACKED_DBUF_ENTRY_LEN + 3) + 6)
+
+static unsigned char *
+put_varint(unsigned char *p, unsigned int n)
+{
+    while (n >= 0x80) {
+        *p++ = (n & 0x7f) | 0x80;
+        n >>= 7;
+    }
+    *p++ = n;
+    return p;
+}
+
+static unsigned char *
+put_le(unsigned char *p, unsigned int n, int bytes)
+{
+    while (bytes--) {
+        *p++ = n & 0xff;
+        n >>= 8;
+    }
+    return p;
+}
+
+static unsigned char *
+put_dbuf_entry(unsigned char *p, const struct nh_dbuf_entry *dbe)
+{
+    p = put_le(p, dbe->effect, 4);
+    p = put_le(p, (unsigned short)dbe->bg, 2);
+    p = put_le(p, (unsigned short)dbe->trap, 2);
+    p = put_le(p, (unsigned short)dbe->obj, 2);
+    p = put_le(p, (unsigned short)dbe->obj_mn, 2);
+    p = put_le(p, (unsigned short)dbe->mon, 2);
+    p = put_le(p, (unsigned short)dbe->monflags, 2);
+    p = put_le(p, (unsigned short)dbe->branding, 2);
+    *p++ = (dbe->invis ? 1 : 0) | (dbe->visible ? 2 : 0);
+    return p;
+}
+
+static void
+base64_encode_binary(const unsigned char *in, int len, char *out)
+{
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned long w;
+    int i;
+
+    for (i = 0; i + 2 < len; i += 3) {
+        w = ((unsigned long)in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *out++ = b64[(w >> 18) & 63];
+        *out++ = b64[(w >> 12) & 63];
+        *out++ = b64[(w >> 6) & 63];
+        *out++ = b64[w & 63];
+    }
+    if (i < len) {
+        w = (unsigned long)in[i] << 16;
+        if (i + 1 < len)
+            w |= in[i + 1] << 8;
+        *out++ = b64[(w >> 18) & 63];
+        *out++ = b64[(w >> 12) & 63];
+        *out++ = i + 1 < len ? b64[(w >> 6) & 63] : '=';
+        *out++ = '=';
+    }
+    *out = '\0';
+}
+
+static void
+srv_update_screen_binary(struct nh_dbuf_entry dbuf[ROWNO][COLNO],
+                         int ux, int uy)
+{
+    static unsigned char bin[MAX_BINARY_DBUF_LEN];
+    static char b64[MAX_BINARY_DBUF_LEN / 3 * 4 + 5];
+    unsigned char *p = bin;
+    int i, start, skip, all_zero = TRUE;
+    json_t *jmsg;
+
+#define DBE(i) (&dbuf[(i) / COLNO][(i) % COLNO])
+#define SAME(i) (!memcmp(DBE(i), &prev_dbuf[(i) / COLNO][(i) % COLNO], \
+                         sizeof (struct nh_dbuf_entry)))
+
+    i = 0;
+    while (i < ROWNO * COLNO) {
+        start = i;
+        while (i < ROWNO * COLNO && SAME(i))
+            i++;
+        if (i == ROWNO * COLNO)
+            break;
+        skip = i - start;
+
+        start = i;
+        while (i < ROWNO * COLNO && !SAME(i))
+            i++;
+
+        p = put_varint(p, skip);
+        p = put_varint(p, i - start);
+        for (; start < i; start++) {
+            if (memcmp(DBE(start), &zero_dbuf, sizeof zero_dbuf))
+                all_zero = FALSE;
+            p = put_dbuf_entry(p, DBE(start));
+        }
+    }
+
+    if (p == bin)
+        return; /* nothing changed */
+
+    /* A cleared screen is far more compactly sent the old way; but only if the
+       unchanged cells were zero too. */
+    for (i = 0; all_zero && i < ROWNO * COLNO; i++)
+        if (memcmp(DBE(i), &zero_dbuf, sizeof zero_dbuf))
+            all_zero = FALSE;
+
+#undef SAME
+#undef DBE
+
+    if (all_zero)
+        jmsg = json_pack("{si,si,si}", "ux", ux, "uy", uy, "dbuf", 0);
+    else {
+        base64_encode_binary(bin, p - bin, b64);
+        jmsg = json_pack("{si,si,ss}", "ux", ux, "uy", uy, "dbuf", b64);
+    }
+
+    add_display_data("update_screen", jmsg);
+
+    for (i = 0; i < ROWNO; i++)
+        memcpy(&prev_dbuf[i], &dbuf[i], sizeof (dbuf[i]));
+}
+
+
 static void
 srv_update_screen(struct nh_dbuf_entry dbuf[ROWNO][COLNO], int ux, int uy)
 {
     int i, x, y, samedbe, samecols, zerodbe, zerocols, is_same, is_zero;
     json_t *jmsg, *jdbuf, *dbufcol, *dbufent;
 
+    if (binary_dbuf) {
+        srv_update_screen_binary(dbuf, ux, uy);
+        return;
+    }
+
     samecols = 0;
     zerocols = 0;
     jdbuf = json_array();
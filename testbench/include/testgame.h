@@ -4,9 +4,35 @@
 /* NetHack may be freely redistributed.  See license for details. */
 
 #include "compilers.h"
+#include "nethack_types.h"
 #include <stdbool.h>
 
+/* Wall-clock time taken by each command sent to the engine, in seconds, from
+   sending the command to the next command request (so including any prompts
+   the command asked along the way). */
+struct test_latencies {
+    double *seconds;
+    int count;
+    int size;
+};
+
+/* Measurements taken by play_measured_test_game. */
+struct test_game_stats {
+    bool replay;                        /* in: replay the finished game */
+    struct test_latencies play_latencies;
+    struct test_latencies replay_latencies;
+    struct nh_profile play_profile;     /* from nh_get_profile */
+    struct nh_profile replay_profile;
+    int turns;                          /* turn counter at the end of play */
+    long long save_bytes;               /* save file size at the end of play */
+    int restores;                       /* number of "detach" commands run */
+};
+
 extern void init_test_system(unsigned long long, const char[static 4], int);
 extern void shutdown_test_system(void);
 extern void play_test_game(const char *, bool);
+extern bool play_measured_test_game(const char *, bool,
+                                    struct test_game_stats *);
 extern void skip_test_game(const char *, bool);
+extern void pass_over_test_game(const char *, bool);
+extern void free_test_game_stats(struct test_game_stats *);
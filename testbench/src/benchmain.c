@@ -0,0 +1,289 @@
+/* vim:set cin ft=c sw=4 sts=4 ts=8 et ai cino=Ls\:0t0(0 : -*- mode:c;fill-column:80;tab-width:8;c-basic-offset:4;indent-tabs-mode:nil;c-file-style:"k&r" -*-*/
+/* NetHack may be freely redistributed.  See license for details. */
+
+#ifdef AIMAKE_BUILDOS_MSWin32
+# error !AIMAKE_FAIL_SILENTLY! Benchmarking on Windows is not yet supported.
+#endif
+
+#include "nethack.h"
+#include "tap.h"
+#include "testgame.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Performance benchmarks. Each scenario is a fixed command string played on a
+   fixed seed by the testbench (so the game played is the same from run to run,
+   and any difference in the results is down to the engine); the TAP output on
+   stdout reports whether each scenario ran correctly, and the measurements go
+   to the output file as JSON, one line per scenario, so that they can be
+   compared between builds. */
+
+struct scenario {
+    const char *name;
+    bool replay;        /* report on replaying the game, not playing it */
+    void (*commands)(char *, size_t);
+};
+
+/* Appends the printf-formatted text to buf (of total size bufsize), with a
+   comma separator. */
+static void
+add_commands(char *buf, size_t bufsize, const char *fmt, ...)
+    PRINTFLIKE(3, 4);
+
+static void
+add_commands(char *buf, size_t bufsize, const char *fmt, ...)
+{
+    size_t len = strlen(buf);
+    va_list v;
+
+    if (len && len + 1 < bufsize)
+        buf[len++] = ',';
+    va_start(v, fmt);
+    if (vsnprintf(buf + len, bufsize - len, fmt, v) >= (int)(bufsize - len))
+        tap_bail("benchmark command string too long");
+    va_end(v);
+}
+
+/* Autoexplore the first few levels of the dungeon, going down when each one
+   has been explored as far as it will go. */
+static void
+autoexplore_commands(char *buf, size_t bufsize)
+{
+    int depth, i;
+
+    for (depth = 1; depth <= 8; depth++) {
+        if (depth > 1)
+            add_commands(buf, bufsize, "levelteleport,\"%d\"", depth);
+        for (i = 0; i < 20; i++)
+            add_commands(buf, bufsize, "autoexplore");
+    }
+}
+
+/* Around 500 turns of fighting, with fresh monsters summoned every 50 turns.
+   The searches make sure that time passes even when the fight command finds
+   nothing to attack. */
+static void
+arena_commands(char *buf, size_t bufsize)
+{
+    static const char *const monsters[] = {
+        "soldier ant", "hill orc", "dwarf", "jackal", "gnome lord",
+        "giant beetle", "kobold shaman", "wolf",
+    };
+    int turn;
+
+    for (turn = 0; turn < 500; turn += 2) {
+        if (turn % 50 == 0)
+            add_commands(buf, bufsize, "genesis,\"%s\"",
+                         monsters[(turn / 50) % (sizeof monsters /
+                                                 sizeof *monsters)]);
+        add_commands(buf, bufsize, "fight,search");
+    }
+}
+
+/* Generate every level of the main dungeon (teleports past the bottom go to
+   the bottom level). */
+static void
+levelgen_commands(char *buf, size_t bufsize)
+{
+    int depth;
+
+    for (depth = 2; depth <= 50; depth++)
+        add_commands(buf, bufsize, "levelteleport,\"%d\"", depth);
+}
+
+/* Build up a save file with many levels and a full inventory, then save and
+   reload it repeatedly. */
+static void
+saverestore_commands(char *buf, size_t bufsize)
+{
+    static const char *const wishes[] = {
+        "blessed +3 gray dragon scale mail", "blessed +3 speed boots",
+        "blessed +2 silver saber", "blessed bag of holding",
+        "blessed magic marker", "3 blessed scrolls of enchant armor",
+        "blessed amulet of life saving", "7 blessed potions of full healing",
+    };
+    int i;
+
+    for (i = 2; i <= 30; i += 2)
+        add_commands(buf, bufsize, "levelteleport,\"%d\"", i);
+    for (i = 0; i < sizeof wishes / sizeof *wishes; i++)
+        add_commands(buf, bufsize, "wish,\"%s\"", wishes[i]);
+    for (i = 0; i < 100; i++)
+        add_commands(buf, bufsize, "search");
+    for (i = 0; i < 20; i++)
+        add_commands(buf, bufsize, "detach");
+}
+
+/* Replay a long game (the autoexplore scenario's), seeking through it. */
+static void
+replay_commands(char *buf, size_t bufsize)
+{
+    autoexplore_commands(buf, bufsize);
+}
+
+static const struct scenario scenarios[] = {
+    {"autoexplore", false, autoexplore_commands},
+    {"arena", false, arena_commands},
+    {"levelgen", false, levelgen_commands},
+    {"saverestore", false, saverestore_commands},
+    {"replay", true, replay_commands},
+};
+
+static const char *const profile_section_names[NHPROF_COUNT] = {
+    [NHPROF_SAVEGAME] = "savegame",
+    [NHPROF_MDIFFAPPLY] = "mdiffapply",
+    [NHPROF_DORECOVER] = "dorecover",
+    [NHPROF_VISION_RECALC] = "vision_recalc",
+    [NHPROF_MOVEMON] = "movemon",
+};
+
+static int
+compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of a sorted array, in microseconds. */
+static double
+percentile(const double *sorted, int count, int pct)
+{
+    int rank = (count * pct + 99) / 100;
+
+    if (!count)
+        return 0;
+    return sorted[rank ? rank - 1 : 0] * 1e6;
+}
+
+static void
+write_result(FILE *out, const char *name, unsigned long long seed, bool ok,
+             const struct test_game_stats *stats)
+{
+    const struct test_latencies *tl = stats->replay ?
+        &stats->replay_latencies : &stats->play_latencies;
+    const struct nh_profile *prof = stats->replay ?
+        &stats->replay_profile : &stats->play_profile;
+    double *sorted = malloc((tl->count + 1) * sizeof *sorted);
+    double total = 0;
+    int i;
+
+    if (!sorted)
+        tap_bail_errno("allocating benchmark results");
+    if (tl->count)
+        memcpy(sorted, tl->seconds, tl->count * sizeof *sorted);
+    qsort(sorted, tl->count, sizeof *sorted, compare_doubles);
+    for (i = 0; i < tl->count; i++)
+        total += sorted[i];
+
+    fprintf(out, "{\"scenario\": \"%s\", \"seed\": %llu, \"ok\": %s, "
+            "\"commands\": %d, \"turns\": %d, \"restores\": %d, "
+            "\"save_bytes\": %lld, \"save_bytes_per_turn\": %.1f, ",
+            name, seed, ok ? "true" : "false", tl->count, stats->turns,
+            stats->restores, stats->save_bytes,
+            stats->turns ? (double)stats->save_bytes / stats->turns : 0.0);
+    fprintf(out, "\"latency_us\": {\"mean\": %.1f, \"p50\": %.1f, "
+            "\"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}, ",
+            tl->count ? total / tl->count * 1e6 : 0.0,
+            percentile(sorted, tl->count, 50),
+            percentile(sorted, tl->count, 90),
+            percentile(sorted, tl->count, 99),
+            percentile(sorted, tl->count, 100));
+    fprintf(out, "\"profile\": {");
+    for (i = 0; i < NHPROF_COUNT; i++)
+        fprintf(out, "%s\"%s\": {\"calls\": %llu, \"ms\": %.3f}",
+                i ? ", " : "", profile_section_names[i], prof->calls[i],
+                prof->nanoseconds[i] / 1e6);
+    fprintf(out, "}}\n");
+    fflush(out);
+
+    free(sorted);
+}
+
+int
+main(int argc, char **argv)
+{
+    unsigned long long seed = 1;
+    const char *outname = "benchmark.jsonl";
+    bool verbose = false;
+    char *endptr;
+    int i;
+
+    while (argc > 1) {
+        if (argc == 2) {
+            fprintf(stderr, "Usage:\n"
+                    "  benchmain [options]\n\n"
+                    "Runs the performance benchmarks, reporting whether\n"
+                    "they ran correctly in TAP format on stdout, and the\n"
+                    "measurements as JSON lines in the output file.\n\n"
+                    "Options:\n"
+                    "  --seed seed\n"
+                    "    Benchmark a different set of games (default 1).\n"
+                    "    Only results with the same seed are comparable.\n\n"
+                    "  --output filename\n"
+                    "    Where to write the results (default\n"
+                    "    benchmark.jsonl; \"-\" for stderr).\n\n"
+                    "  --verbose 0|1\n"
+                    "    Produce verbose comments in the TAP output.\n");
+            return (strcmp(argv[1], "--help") ? EXIT_FAILURE : 0);
+        }
+
+        if (strcmp(argv[1], "--output") == 0)
+            outname = argv[2];
+        else {
+            unsigned long long parsevalue = strtoull(argv[2], &endptr, 10);
+            if (!*argv[2] || *endptr) {
+                fprintf(stderr, "Option value '%s' is not an integer\n",
+                        argv[2]);
+                return EXIT_FAILURE;
+            }
+
+            if (strcmp(argv[1], "--seed") == 0)
+                seed = parsevalue;
+            else if (strcmp(argv[1], "--verbose") == 0)
+                verbose = parsevalue;
+            else {
+                fprintf(stderr, "Unknown option '%s'\n", argv[1]);
+                return EXIT_FAILURE;
+            }
+        }
+
+        argv += 2;
+        argc -= 2;
+    }
+
+    FILE *out = strcmp(outname, "-") ? fopen(outname, "w") : stderr;
+    if (!out) {
+        perror(outname);
+        return EXIT_FAILURE;
+    }
+
+    const int count = sizeof scenarios / sizeof *scenarios;
+    char commands[65536];
+    int failures = 0;
+
+    init_test_system(seed, "wgfn", count);
+    nh_set_profiling(true);
+
+    for (i = 0; i < count; i++) {
+        struct test_game_stats stats = {.replay = scenarios[i].replay};
+        bool ok;
+
+        *commands = '\0';
+        scenarios[i].commands(commands, sizeof commands);
+        tap_comment("scenario: %s", scenarios[i].name);
+        ok = play_measured_test_game(commands, verbose, &stats);
+        if (!ok)
+            failures++;
+
+        write_result(out, scenarios[i].name, seed, ok, &stats);
+        free_test_game_stats(&stats);
+    }
+
+    nh_set_profiling(false);
+    shutdown_test_system();
+    if (out != stderr)
+        fclose(out);
+    return failures ? EXIT_FAILURE : 0;
+}
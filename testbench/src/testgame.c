@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <time.h>
 
 static unsigned long long test_seed;
 static char temp_directory[] = "nethack4-testsuite-XXXXXX\0";
@@ -34,6 +35,13 @@ static const char *curcmd, *curcmd_ptr;
 static char test_crga[4];
 static int last_monster_d, last_monster_x, last_monster_y;
 
+/* Benchmarking state; see play_measured_test_game. */
+static struct test_latencies *test_latencies = NULL;
+static double command_sent_at = -1;
+static bool detach_requested = false;
+static bool test_replaying = false;
+static int status_turn, replay_seek_turn;
+
 static void test_pause(enum nh_pause_reason);
 static void test_display_buffer(const char *, nh_bool);
 static void test_update_status(struct nh_player_info *);
@@ -93,6 +101,41 @@ gridbug_ok(enum nh_direction dir, bool gridbug)
                          dir == DIR_NE || dir == DIR_SE));
 }
 
+static double
+test_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Called just before a command is sent to the engine. */
+static void
+start_command_timing(void)
+{
+    if (test_latencies)
+        command_sent_at = test_clock();
+}
+
+/* Called when the engine asks for the next command, or the game ends. */
+static void
+finish_command_timing(void)
+{
+    struct test_latencies *tl = test_latencies;
+
+    if (!tl || command_sent_at < 0)
+        return;
+
+    if (tl->count == tl->size) {
+        tl->size = tl->size ? tl->size * 2 : 1024;
+        tl->seconds = realloc(tl->seconds, tl->size * sizeof *tl->seconds);
+        if (!tl->seconds)
+            tap_bail_errno("allocating command latencies");
+    }
+    tl->seconds[tl->count++] = test_clock() - command_sent_at;
+    command_sent_at = -1;
+}
+
 
 /* Initialization. */
 
@@ -103,7 +146,9 @@ init_test_system(unsigned long long seed, const char crga[static 4],
     if (test_system_inited)
         tap_bail("Initializing test system twice");
 
-    tap_init(testcount);
+    /* A negative testcount means that some other process prints the plan. */
+    if (testcount >= 0)
+        tap_init(testcount);
     test_seed = seed;
     memcpy(test_crga, crga, 4);
 
@@ -189,6 +234,7 @@ shutdown_test_system(void)
  * Dm          (literal)                                 getdir on monster
  * Yy          (capital Y then one letter)               yn
  * "7 candles" (string in double-quotes)                 getlin
+ * detach      (literal)                                 save and reload
  *
  * In most cases, if a prompt appears that doesn't appear in "commands", the
  * testbench will improvise an appropriate response. The exception is an
@@ -204,6 +250,20 @@ shutdown_test_system(void)
  */
 void
 play_test_game(const char *commands, bool verbose)
+{
+    play_measured_test_game(commands, verbose, NULL);
+}
+
+/*
+ * Like play_test_game, but also fills in *stats (if it isn't NULL) with
+ * timings for a benchmark; profiling should have been turned on with
+ * nh_set_profiling. If stats->replay is set, the finished game is then
+ * replayed, seeking forwards 50 turns per command until the end. Returns true
+ * if the test passed.
+ */
+bool
+play_measured_test_game(const char *commands, bool verbose,
+                        struct test_game_stats *stats)
 {
     curcmd = commands;
     curcmd_ptr = curcmd;
@@ -221,6 +281,14 @@ play_test_game(const char *commands, bool verbose)
     last_monster_y = -1;
     cmdnumber = 0;
 
+    test_latencies = stats ? &stats->play_latencies : NULL;
+    command_sent_at = -1;
+    detach_requested = false;
+    test_replaying = false;
+    status_turn = 0;
+    if (stats)
+        nh_get_profile(&stats->play_profile, true);
+
     char paniclog[strlen(temp_directory) + 9];
     strcpy(paniclog, temp_directory);
     strcat(paniclog, "paniclog");
@@ -294,6 +362,7 @@ play_test_game(const char *commands, bool verbose)
        something goes wrong (and try with other seeds) */
 
     enum nh_create_response nhcr = nh_create_game(fd, newgame_options);
+    struct stat savestat;
     bool start_or_restart = true;
     bool ok = false;
     bool keep_savefile = false;
@@ -322,8 +391,15 @@ play_test_game(const char *commands, bool verbose)
                 break;
 
                 /* Normally benign, but should be caused only via client action,
-                   and we haven't caused them. */
+                   and we haven't caused them unless the commands asked. */
             case GAME_DETACHED:
+                if (detach_requested) {
+                    detach_requested = false;
+                    start_or_restart = true;
+                    if (stats)
+                        stats->restores++;
+                    break;
+                }
                 tap_comment("playing game: unexpected detach");
                 break;
             case GAME_ALREADY_OVER:
@@ -363,6 +439,34 @@ play_test_game(const char *commands, bool verbose)
                 break;
             }
         }
+
+        finish_command_timing();
+        if (!stats)
+            break;
+
+        nh_get_profile(&stats->play_profile, true);
+        stats->turns = status_turn;
+        if (fstat(fd, &savestat) == 0)
+            stats->save_bytes = savestat.st_size;
+
+        if (ok && stats->replay) {
+            test_latencies = &stats->replay_latencies;
+            test_replaying = true;
+            replay_seek_turn = -1;
+            switch (nh_play_game(fd, FM_REPLAY)) {
+            case GAME_OVER:
+            case GAME_DETACHED:
+            case REPLAY_FINISHED:
+                break;
+            default:
+                tap_comment("replaying game: bad nh_play_game return");
+                ok = false;
+                break;
+            }
+            test_replaying = false;
+            finish_command_timing();
+            nh_get_profile(&stats->replay_profile, true);
+        }
         break;
     }
 
@@ -405,6 +509,17 @@ play_test_game(const char *commands, bool verbose)
     fclose(savefile);
     close(paniclogfd);
     nhlib_free_optlist(newgame_options);
+
+    test_latencies = NULL;
+    return ok;
+}
+
+void
+free_test_game_stats(struct test_game_stats *stats)
+{
+    free(stats->play_latencies.seconds);
+    free(stats->replay_latencies.seconds);
+    memset(stats, 0, sizeof *stats);
 }
 
 /* Like play_test_game, but doesn't actually run the game. */
@@ -420,6 +535,17 @@ skip_test_game(const char *commands, bool verbose)
     tap_skip(&testnumber, "%s [seed %s]", commands, seedbuf);
 }
 
+/* Like skip_test_game, but without any output, for a test that a different
+   process is running. (This keeps the test numbers, and thus the seeds, of
+   later tests the same as if this test had run here.) */
+void
+pass_over_test_game(const char *commands, bool verbose)
+{
+    (void) commands;
+    (void) verbose;
+    testnumber++;
+}
+
 
 /* Window procedures: error detection */
 
@@ -502,6 +628,24 @@ test_request_command(
     nh_bool debug, nh_bool completed, nh_bool interrupted, void *callbackarg,
     void (*callback)(const struct nh_cmd_and_arg *ncaa, void *arg))
 {
+    finish_command_timing();
+
+    /* When replaying, seek forwards until the turn counter stops moving, then
+       detach (the only way to leave a replay). */
+    if (test_replaying) {
+        if (status_turn == replay_seek_turn) {
+            nh_exit_game(EXIT_SAVE);
+            tap_bail("nh_exit_game returned");
+        }
+        replay_seek_turn = status_turn;
+
+        start_command_timing();
+        callback(&(struct nh_cmd_and_arg){
+                "move", {.argtype = CMD_ARG_DIR, .dir = DIR_SE}},
+            callbackarg);
+        return;
+    }
+
     /* First case: if we gave a multi-turn command, continue it. (Even if we're
        interrupted; we ignore the interruptions, using wizmode lifesaving if
        necessary). */
@@ -510,6 +654,7 @@ test_request_command(
             if (test_verbose)
                 tap_comment("command (interrupted): repeat");
 
+        start_command_timing();
         callback(&(struct nh_cmd_and_arg){"repeat", {.argtype = 0}},
                  callbackarg);
         return;
@@ -543,6 +688,15 @@ test_request_command(
         if (test_verbose)
             tap_comment("command (from command): %s", cmdname);
 
+        start_command_timing();
+
+        /* "detach" isn't a game command; it tests saving and reloading. */
+        if (strcmp(cmdname, "detach") == 0) {
+            detach_requested = true;
+            nh_exit_game(EXIT_SAVE);
+            tap_bail("nh_exit_game returned");
+        }
+
         callback(&(struct nh_cmd_and_arg){cmdname, {.argtype = 0}},
                  callbackarg);
         return;
@@ -1034,9 +1188,9 @@ test_display_buffer(const char *unused1, nh_bool unused2)
 }
 
 static void
-test_update_status(struct nh_player_info *unused)
+test_update_status(struct nh_player_info *pi)
 {
-    (void) unused;
+    status_turn = pi->moves;
 }
 
 static void
@@ -7,6 +7,7 @@
 # error !AIMAKE_FAIL_SILENTLY! Testing on Windows is not yet supported.
 #endif
 
+#include "tap.h"
 #include "testgame.h"
 #include "pm.h"
 #include "onames.h"
@@ -14,6 +15,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 /* Commands that take an item and/or monster as argument, are usable by a level
    1 wizard, and don't have specific requirements on the adjacent terrain or on
@@ -26,25 +32,33 @@ const char *const testable_commands[] = {
 
 const int unused_objects[] = UNUSEDOBJECTS;
 
+/* We currently use hardcoded values for the first "abnormal" monster/item,
+   so that we don't need full access to the game logic. */
+#define UNUSEDITEMCOUNT (sizeof unused_objects / sizeof *unused_objects)
+#define MONCOUNT (PM_LONG_WORM_TAIL - 0)
+#define ITEMCOUNT (BLINDING_VENOM - 1 - (int)UNUSEDITEMCOUNT)
+#define CMDCOUNT (sizeof testable_commands / sizeof *testable_commands)
+
 /* The idea behind the round-robin test is that, for each <item, monster,
    command> triple, we wish up the item, summon the monster, then use the
    command (specifying the item and the monster's position as arguments, if
-   necessary). */
+   necessary).
+
+   This runs tests number "first" (counting from 0) up to but not including
+   "last"; those before "skip" are skipped. If "plan" is false, the TAP plan is
+   left for the caller to print. */
 static void
-round_robin_test(unsigned long long seed, unsigned long long skip,
-                 unsigned long long limit, bool verbose)
+round_robin_shard(unsigned long long seed, unsigned long long skip,
+                  unsigned long long first, unsigned long long last,
+                  bool verbose, bool plan)
 {
-    const int unuseditemcount = sizeof unused_objects / sizeof *unused_objects;
-
-    /* We currently use hardcoded values for the first "abnormal" monster/item,
-       so that we don't need full access to the game logic. */
-    const int moncount = PM_LONG_WORM_TAIL - 0;
-    const int itemcount = BLINDING_VENOM - 1 - unuseditemcount;
-    const int cmdcount = sizeof testable_commands / sizeof *testable_commands;
-    if (limit > moncount * itemcount * cmdcount - skip)
-        limit = moncount * itemcount * cmdcount - skip;
+    const int unuseditemcount = UNUSEDITEMCOUNT;
+    const int moncount = MONCOUNT;
+    const int itemcount = ITEMCOUNT;
+    const int cmdcount = CMDCOUNT;
+    unsigned long long testindex = 0;
 
-    init_test_system(seed, "wgfn", skip + limit);
+    init_test_system(seed, "wgfn", plan ? (int)last : -1);
 
     /* We want to test all (cmd, mon, item) triples, but in an order that cycles
        through each individual command/monster/item as quickly as possible, and
@@ -75,13 +89,7 @@ round_robin_test(unsigned long long seed, unsigned long long skip,
             if (unused_objects[j] == item + 1)
                 goto continue_main_loop;
 
-        boolean skipping = false;
-        if (skip) {
-            --skip;
-            skipping = true;
-        } else if (limit)
-            --limit;
-        else
+        if (testindex >= last)
             break;
 
         char teststring[512];
@@ -90,7 +98,10 @@ round_robin_test(unsigned long long seed, unsigned long long skip,
                  "wish,\"Z - otyp #%d\",%s,wear,wield,fight,fight,cast,zap,"
                  "read,drink,fight,fight,wait,wait,%s,wait,wait,wait",
                  mon, item + 1, testable_commands[cmd], testable_commands[cmd]);
-        (skipping ? skip_test_game : play_test_game)(teststring, verbose);
+        (testindex < first ? pass_over_test_game :
+         testindex < skip ? skip_test_game :
+         play_test_game)(teststring, verbose);
+        testindex++;
 
     continue_main_loop:;
     }
@@ -98,12 +109,88 @@ round_robin_test(unsigned long long seed, unsigned long long skip,
     shutdown_test_system();
 }
 
+/* Runs the round-robin tests after the first "skip", up to "limit" of them,
+   split between "jobs" worker processes. Each worker runs a contiguous range
+   of the tests, with its output going to a temporary file; we copy the files
+   to stdout in order, so that the TAP stream is the same as if one process had
+   run everything. */
+static void
+round_robin_test(unsigned long long seed, unsigned long long skip,
+                 unsigned long long limit, bool verbose, int jobs)
+{
+    const unsigned long long total = MONCOUNT * ITEMCOUNT * CMDCOUNT;
+    int i;
+
+    if (skip > total)
+        skip = total;
+    if (limit > total - skip)
+        limit = total - skip;
+    if (jobs > limit)
+        jobs = limit;
+
+    if (jobs <= 1) {
+        round_robin_shard(seed, skip, 0, skip + limit, verbose, true);
+        return;
+    }
+
+    pid_t workers[jobs];
+    FILE *outputs[jobs];
+
+    tap_init(skip + limit);
+    fflush(stdout);
+
+    for (i = 0; i < jobs; i++) {
+        /* The first worker also prints the skipped tests. */
+        unsigned long long first = i ? skip + limit * i / jobs : 0;
+        unsigned long long last = skip + limit * (i + 1) / jobs;
+
+        outputs[i] = tmpfile();
+        if (!outputs[i])
+            tap_bail_errno("creating a test output file");
+
+        workers[i] = fork();
+        if (workers[i] < 0)
+            tap_bail_errno("starting a test worker");
+        if (workers[i] == 0) {
+            if (dup2(fileno(outputs[i]), STDOUT_FILENO) < 0)
+                tap_bail_errno("redirecting test worker output");
+            /* so that a bail out isn't lost in the buffer */
+            setvbuf(stdout, NULL, _IOLBF, 0);
+            round_robin_shard(seed, skip, first, last, verbose, false);
+            exit(EXIT_SUCCESS);
+        }
+    }
+
+    for (i = 0; i < jobs; i++) {
+        int status, j;
+        char buf[4096];
+        size_t len;
+
+        while (waitpid(workers[i], &status, 0) < 0)
+            if (errno != EINTR)
+                tap_bail_errno("waiting for a test worker");
+
+        rewind(outputs[i]);
+        while ((len = fread(buf, 1, sizeof buf, outputs[i])) > 0)
+            fwrite(buf, 1, len, stdout);
+        fclose(outputs[i]);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            for (j = i + 1; j < jobs; j++)
+                kill(workers[j], SIGKILL);
+            fflush(stdout);
+            tap_bail("test worker exited abnormally");
+        }
+    }
+}
+
 int
 main(int argc, char **argv)
 {
     unsigned long long seed = time(NULL);
     unsigned long long limit = -(1ULL);
     unsigned long long skip = 0;
+    int jobs = 1;
     char *endptr;
 
     while (argc > 1) {
@@ -125,7 +212,11 @@ main(int argc, char **argv)
                     "    testsuite.\n\n"
                     "  --stdoutbuffer count\n"
                     "    Adjust the size of the buffer used on stdout (0 =\n"
-                    "    use line buffering for stdout)\n");
+                    "    use line buffering for stdout)\n\n"
+                    "  --jobs count\n"
+                    "    Run the tests in the given number of processes\n"
+                    "    at once. The output is the same, but appears a\n"
+                    "    block of tests at a time.\n");
             return (strcmp(argv[1], "--help") ? EXIT_FAILURE : 0);
         }
 
@@ -143,6 +234,8 @@ main(int argc, char **argv)
             skip = parsevalue;
         else if (strcmp(argv[1], "--stdoutbuffer") == 0)
             setvbuf(stdout, NULL, parsevalue ? _IOFBF : _IOLBF, parsevalue);
+        else if (strcmp(argv[1], "--jobs") == 0)
+            jobs = parsevalue < 1 ? 1 : parsevalue > 1024 ? 1024 : parsevalue;
         else {
             fprintf(stderr, "Unknown option '%s'\n", argv[1]);
             return EXIT_FAILURE;
@@ -152,6 +245,6 @@ main(int argc, char **argv)
         argc -= 2;
     }
 
-    round_robin_test(seed, skip, limit, limit < 10);
+    round_robin_test(seed, skip, limit, limit < 10, jobs);
     return 0;
 }